@@ -0,0 +1,402 @@
+#include "collisionEngine.h"
+#include "gameObjects.h"
+#include "narrowphase.h"
+#include "physicsEngine.h"
+#include "threadPool.h"
+#include "worldBatch.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Steps the physics engine headless and reports the time per step of each
+// storage mode. Every storage mode has to end in bit-identical positions, the
+// exit status is 1 when one does not. The narrowphase kernels are then timed
+// against objectsCollided on the same candidate pairs, and have to find the
+// same colliding pairs. Last, a batch of small worlds is stepped on one thread
+// and across a pool, which have to end in the same state.
+
+#define BENCH_WORLD_WIDTH 4000
+#define BENCH_WORLD_HEIGHT 3000
+#define BENCH_GRAVITY 1.0
+#define BENCH_JUMP_IMPULSE 10.0
+#define BENCH_WALKING_SPEED 150.0
+#define BENCH_FRAME_DURATION 16
+#define BENCH_OBJECT_SIZE 8
+// Objects stacked on top of each other in the waking up scene
+#define BENCH_STACK_HEIGHT 2
+// Runs of each configuration, the fastest one is reported
+#define BENCH_REPETITIONS 3
+// Longest step that still fits a frame, in milliseconds
+#define BENCH_STEP_BUDGET 30
+// Scattered objects the narrowphase candidate pairs are taken from
+#define BENCH_NARROWPHASE_OBJECTS 20000
+// Worlds of the world batch case, each holding a few objects
+#define BENCH_BATCH_WORLDS 500
+#define BENCH_BATCH_OBJECTS 50
+#define BENCH_BATCH_WORLD_WIDTH 800
+#define BENCH_BATCH_WORLD_HEIGHT 600
+#define BENCH_BATCH_STEPS 100
+// Steps run by each call to WorldBatch::step
+#define BENCH_BATCH_STEPS_PER_CALL 10
+
+struct BenchScene {
+  const char *name;
+  int objectCount;
+  bool collisions;
+  int steps;
+  std::vector<std::shared_ptr<GameObject>> (*createObjects)(int objectCount);
+};
+
+struct BenchResult {
+  double millisecondsPerStep;
+  std::vector<double> positions;
+};
+
+static std::unique_ptr<PhysicsEngine> createEngine(bool collisions) {
+  CollisionEngineFactory collisionEngineFactory;
+  CollisionEngine *collisionEngine =
+      collisionEngineFactory.createCollisionEngine(
+          UNIFORM_GRID, BENCH_WORLD_WIDTH, BENCH_WORLD_HEIGHT);
+
+  return std::make_unique<XPhysicsEngine>(
+      BENCH_GRAVITY, BENCH_JUMP_IMPULSE, BENCH_WALKING_SPEED, BENCH_WORLD_WIDTH,
+      BENCH_WORLD_HEIGHT, BENCH_FRAME_DURATION, collisionEngine, collisions);
+}
+
+static std::shared_ptr<GameObject> createObject(int id, double x, double y,
+                                               double speedX, double speedY) {
+  GameObjectFactory gameObjectFactory;
+  std::shared_ptr<GameObject> gameObject =
+      gameObjectFactory.createGameObject(RECTANGLE, id);
+  gameObject->position = physics::Position2D(x, y);
+  gameObject->previousPosition = gameObject->position;
+  gameObject->speed = physics::Speed2D(speedX, speedY);
+  gameObject->width = gameObject->hitboxWidth = BENCH_OBJECT_SIZE;
+  gameObject->height = gameObject->hitboxHeight = BENCH_OBJECT_SIZE;
+  gameObject->mass = 1;
+  return gameObject;
+}
+
+/**
+ * Scatter objectCount objects over the world, the same way on every call
+ */
+static std::vector<std::shared_ptr<GameObject>>
+createScatteredObjects(int objectCount) {
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> x(0, BENCH_WORLD_WIDTH -
+                                                  BENCH_OBJECT_SIZE);
+  std::uniform_real_distribution<double> y(0, BENCH_WORLD_HEIGHT -
+                                                  BENCH_OBJECT_SIZE);
+  std::uniform_real_distribution<double> speed(-20, 20);
+
+  std::vector<std::shared_ptr<GameObject>> gameObjects;
+  for (int i = 0; i < objectCount; i++) {
+    double positionX = x(random);
+    double positionY = y(random);
+    double speedX = speed(random);
+    double speedY = speed(random);
+    gameObjects.push_back(
+        createObject(i, positionX, positionY, speedX, speedY));
+  }
+  return gameObjects;
+}
+
+/**
+ * Stacks of objects resting on the floor, and an object falling onto each
+ * from high up. The stacks fall asleep before being hit and come after the
+ * falling objects in storage, so they are woken up by objects stepped before
+ * them. Stacked objects are held up by contacts, and fall when a tick skips
+ * them
+ */
+static std::vector<std::shared_ptr<GameObject>>
+createWakingObjects(int objectCount) {
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> y(0, BENCH_WORLD_HEIGHT / 2);
+
+  int columns = std::max(objectCount / (BENCH_STACK_HEIGHT + 1), 1);
+  double spacing = (double)BENCH_WORLD_WIDTH / columns;
+
+  std::vector<std::shared_ptr<GameObject>> gameObjects;
+  for (int i = 0; i < columns; i++) {
+    gameObjects.push_back(createObject(i, i * spacing, y(random), 0, 0));
+  }
+  for (int level = 1; level <= BENCH_STACK_HEIGHT; level++) {
+    for (int i = 0; i < columns; i++) {
+      gameObjects.push_back(createObject(
+          (int)gameObjects.size(), i * spacing,
+          BENCH_WORLD_HEIGHT - level * BENCH_OBJECT_SIZE, 0, 0));
+    }
+  }
+  return gameObjects;
+}
+
+static BenchResult run(const BenchScene &scene,
+                       PhysicsStorageMode storageMode) {
+  BenchResult result;
+  result.millisecondsPerStep = 0;
+
+  for (int repetition = 0; repetition < BENCH_REPETITIONS; repetition++) {
+    std::unique_ptr<PhysicsEngine> engine = createEngine(scene.collisions);
+    std::vector<std::shared_ptr<GameObject>> gameObjects =
+        scene.createObjects(scene.objectCount);
+    for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
+      engine->addGameObject(*iter);
+    }
+    engine->setStorageMode(storageMode);
+
+    std::chrono::time_point<std::chrono::steady_clock> start =
+        std::chrono::steady_clock::now();
+    for (int i = 0; i < scene.steps; i++) {
+      engine->stepBy(BENCH_FRAME_DURATION);
+    }
+    // Array storage brings game objects up to date once they are read
+    engine->syncObjects();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    double millisecondsPerStep = elapsed.count() / scene.steps;
+    if (repetition == 0 || millisecondsPerStep < result.millisecondsPerStep) {
+      result.millisecondsPerStep = millisecondsPerStep;
+    }
+
+    result.positions.clear();
+    for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
+      result.positions.push_back((*iter)->position.x);
+      result.positions.push_back((*iter)->position.y);
+    }
+  }
+  return result;
+}
+
+/**
+ * Candidate pairs a sweep along the X axis would report: every pair of
+ * objects whose hitboxes overlap on X, most of which miss on Y
+ */
+static std::vector<std::pair<int, int>> createCandidatePairs(
+    const std::vector<std::shared_ptr<GameObject>> &gameObjects) {
+  std::vector<int> order(gameObjects.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](int i1, int i2) {
+    return AABB::fromHitbox(*gameObjects[i1]).minX <
+           AABB::fromHitbox(*gameObjects[i2]).minX;
+  });
+
+  std::vector<std::pair<int, int>> pairs;
+  for (size_t i = 0; i < order.size(); i++) {
+    double maxX = AABB::fromHitbox(*gameObjects[order[i]]).maxX;
+    for (size_t j = i + 1; j < order.size() &&
+                           AABB::fromHitbox(*gameObjects[order[j]]).minX < maxX;
+         j++) {
+      pairs.emplace_back(order[i], order[j]);
+    }
+  }
+  return pairs;
+}
+
+/**
+ * Fastest of BENCH_REPETITIONS runs of benchmark, in milliseconds
+ */
+template <typename Benchmark> static double timeBest(Benchmark benchmark) {
+  double best = 0;
+  for (int repetition = 0; repetition < BENCH_REPETITIONS; repetition++) {
+    std::chrono::time_point<std::chrono::steady_clock> start =
+        std::chrono::steady_clock::now();
+    benchmark();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (repetition == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  return best;
+}
+
+/**
+ * Time testing the same candidate pairs with objectsCollided and with each
+ * narrowphase kernel the CPU supports
+ *
+ * @return whether every kernel found the pairs objectsCollided found
+ */
+static bool runNarrowphase(int objectCount) {
+  std::vector<std::shared_ptr<GameObject>> gameObjects =
+      createScatteredObjects(objectCount);
+  std::vector<std::pair<int, int>> pairs = createCandidatePairs(gameObjects);
+  std::printf("narrowphase, %zu candidate pairs of %d objects\n", pairs.size(),
+              objectCount);
+
+  CollisionEngineFactory collisionEngineFactory;
+  std::unique_ptr<CollisionEngine> collisionEngine(
+      collisionEngineFactory.createCollisionEngine(
+          UNIFORM_GRID, BENCH_WORLD_WIDTH, BENCH_WORLD_HEIGHT));
+
+  std::vector<CollidingPair> reference;
+  double milliseconds = timeBest([&]() {
+    reference.clear();
+    for (auto iter = pairs.begin(); iter != pairs.end(); iter++) {
+      if (collisionEngine->objectsCollided(gameObjects[iter->first],
+                                           gameObjects[iter->second])) {
+        reference.push_back({iter->first, iter->second});
+      }
+    }
+  });
+  std::printf("  %-15s %8.3f ms, %zu colliding\n", "objectsCollided",
+              milliseconds, reference.size());
+
+  AABBPairBatch batch;
+  milliseconds = timeBest([&]() {
+    batch.clear();
+    batch.reserve(pairs.size());
+    for (auto iter = pairs.begin(); iter != pairs.end(); iter++) {
+      batch.add(AABB::fromHitbox(*gameObjects[iter->first]), iter->first,
+                AABB::fromHitbox(*gameObjects[iter->second]), iter->second);
+    }
+  });
+  std::printf("  %-15s %8.3f ms\n", "packing pairs", milliseconds);
+
+  const char *kernelNames[] = {"scalar kernel", "SSE2 kernel", "AVX2 kernel"};
+  bool identical = true;
+  for (int kernel = SCALAR_KERNEL; kernel <= detectNarrowphaseKernel();
+       kernel++) {
+    std::vector<CollidingPair> result;
+    milliseconds = timeBest([&]() {
+      findOverlappingPairs(batch, result, (NarrowphaseKernel)kernel);
+    });
+
+    bool matches = result.size() == reference.size();
+    for (size_t i = 0; matches && i < result.size(); i++) {
+      matches = result[i].index1 == reference[i].index1 &&
+                result[i].index2 == reference[i].index2;
+    }
+    identical = identical && matches;
+    std::printf("  %-15s %8.3f ms%s\n", kernelNames[kernel], milliseconds,
+                matches ? "" : "  DIFFERS");
+  }
+  return identical;
+}
+
+/**
+ * Step a batch of worlds with collisions on, on the calling thread or across
+ * a pool, and keep the gathered positions
+ *
+ * @return world-steps per second
+ */
+static double runWorldBatch(int worldCount,
+                            std::shared_ptr<ThreadPool> threadPool,
+                            std::vector<double> &positions) {
+  WorldConfig config = {BENCH_GRAVITY,
+                        BENCH_JUMP_IMPULSE,
+                        BENCH_WALKING_SPEED,
+                        BENCH_BATCH_WORLD_WIDTH,
+                        BENCH_BATCH_WORLD_HEIGHT,
+                        BENCH_FRAME_DURATION,
+                        true,
+                        UNIFORM_GRID};
+
+  double best = 0;
+  for (int repetition = 0; repetition < BENCH_REPETITIONS; repetition++) {
+    WorldBatch batch(config, worldCount, threadPool);
+    for (int world = 0; world < worldCount; world++) {
+      std::mt19937 random(world + 1);
+      std::uniform_real_distribution<double> x(
+          0, BENCH_BATCH_WORLD_WIDTH - BENCH_OBJECT_SIZE);
+      std::uniform_real_distribution<double> y(
+          0, BENCH_BATCH_WORLD_HEIGHT - BENCH_OBJECT_SIZE);
+      std::uniform_real_distribution<double> speed(-20, 20);
+      for (int i = 0; i < BENCH_BATCH_OBJECTS; i++) {
+        double positionX = x(random);
+        double positionY = y(random);
+        double speedX = speed(random);
+        double speedY = speed(random);
+        batch.addGameObject(
+            world, createObject(i, positionX, positionY, speedX, speedY));
+      }
+    }
+
+    std::chrono::time_point<std::chrono::steady_clock> start =
+        std::chrono::steady_clock::now();
+    for (int steps = 0; steps < BENCH_BATCH_STEPS;
+         steps += BENCH_BATCH_STEPS_PER_CALL) {
+      batch.step(BENCH_BATCH_STEPS_PER_CALL);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    double worldStepsPerSecond =
+        (double)worldCount * BENCH_BATCH_STEPS / elapsed.count();
+    best = std::max(best, worldStepsPerSecond);
+
+    positions.assign(batch.getPositionX().begin(), batch.getPositionX().end());
+    positions.insert(positions.end(), batch.getPositionY().begin(),
+                     batch.getPositionY().end());
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  // Scales the object counts, e.g. 0.1 for a quick run
+  double scale = argc > 1 ? std::atof(argv[1]) : 1;
+
+  const BenchScene scenes[] = {
+      {"free fall", (int)(20000 * scale), false, 200, createScatteredObjects},
+      {"free fall", (int)(100000 * scale), false, 200, createScatteredObjects},
+      {"collisions", (int)(2000 * scale), true, 200, createScatteredObjects},
+      {"waking up", (int)(800 * scale), true, 200, createWakingObjects},
+  };
+  const PhysicsStorageMode storageModes[] = {OBJECT_STORAGE, ARRAY_STORAGE};
+  const char *storageModeNames[] = {"object storage", "array storage"};
+
+  bool identical = true;
+  for (const BenchScene &scene : scenes) {
+    std::printf("%s, %d objects, %d steps\n", scene.name, scene.objectCount,
+                scene.steps);
+
+    std::vector<double> reference;
+    for (int storageMode = 0; storageMode < 2; storageMode++) {
+      BenchResult result = run(scene, storageModes[storageMode]);
+
+      bool matches = true;
+      if (reference.empty()) {
+        reference = result.positions;
+      } else {
+        matches = std::memcmp(reference.data(), result.positions.data(),
+                              reference.size() * sizeof(double)) == 0;
+        identical = identical && matches;
+      }
+      std::printf("  %-15s %8.3f ms/step%s%s\n", storageModeNames[storageMode],
+                  result.millisecondsPerStep, matches ? "" : "  DIFFERS",
+                  result.millisecondsPerStep > BENCH_STEP_BUDGET
+                      ? "  OVER BUDGET"
+                      : "");
+    }
+  }
+
+  identical = runNarrowphase((int)(BENCH_NARROWPHASE_OBJECTS * scale)) &&
+              identical;
+
+  int worldCount = std::max((int)(BENCH_BATCH_WORLDS * scale), 1);
+  int threadCount = std::max((int)std::thread::hardware_concurrency(), 1);
+  std::printf("world batch, %d worlds of %d objects, %d steps\n", worldCount,
+              BENCH_BATCH_OBJECTS, BENCH_BATCH_STEPS);
+
+  std::vector<double> reference, positions;
+  double serial = runWorldBatch(worldCount, nullptr, reference);
+  std::printf("  %-15s %8.0f world-steps/s\n", "one thread", serial);
+
+  double pooled = runWorldBatch(
+      worldCount, std::make_shared<ThreadPool>(threadCount), positions);
+  bool matches = positions == reference;
+  identical = identical && matches;
+  std::printf("  %-15s %8.0f world-steps/s, %.0f per core, %d threads%s\n",
+              "thread pool", pooled, pooled / threadCount, threadCount,
+              matches ? "" : "  DIFFERS");
+
+  return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
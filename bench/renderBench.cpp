@@ -0,0 +1,127 @@
+#include "XManager.h"
+#include "gameObjects.h"
+#include <X11/Xlib.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+// Draws frames of scattered rectangles on the X server of $DISPLAY, an Xvfb
+// server is enough, and counts the requests each frame sends with
+// XNextRequest. Rectangles are filled in batches by XManager, and one request
+// per rectangle by the unbatched manager the batching replaced. The exit
+// status is 1 when batching does not send fewer requests.
+
+#define BENCH_WINDOW_WIDTH 1024
+#define BENCH_WINDOW_HEIGHT 768
+#define BENCH_OBJECT_SIZE 8
+#define BENCH_OBJECT_MASS 1
+#define BENCH_FRAMES 20
+
+/**
+ * Draws like XManager, and gives the requests sent so far on its connection
+ */
+class CountingXManager : public XManager {
+public:
+  CountingXManager(int windowWidth, int windowHeight, int borderWidth)
+      : XManager(windowWidth, windowHeight, borderWidth) {}
+
+  unsigned long nextRequest() { return XNextRequest(display); }
+
+  /**
+   * Wait until the server has handled every request sent
+   */
+  void sync() { XSync(display, False); }
+};
+
+/**
+ * Fills rectangles one XFillRectangle request each, as before batching
+ */
+class UnbatchedXManager : public CountingXManager {
+protected:
+  void fillRectangles(const XRectangle *rectangles, size_t count,
+                      unsigned long pixel) override {
+    XSetForeground(display, gc, pixel);
+    for (size_t i = 0; i < count; i++) {
+      XFillRectangle(display, backBuffer, gc, rectangles[i].x,
+                     rectangles[i].y, rectangles[i].width,
+                     rectangles[i].height);
+    }
+  }
+
+public:
+  UnbatchedXManager(int windowWidth, int windowHeight, int borderWidth)
+      : CountingXManager(windowWidth, windowHeight, borderWidth) {}
+};
+
+struct RenderResult {
+  unsigned long requestsPerFrame;
+  double millisecondsPerFrame;
+};
+
+static RenderResult run(CountingXManager &manager, int objectCount) {
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> x(
+      0, BENCH_WINDOW_WIDTH - BENCH_OBJECT_SIZE);
+  std::uniform_real_distribution<double> y(
+      0, BENCH_WINDOW_HEIGHT - BENCH_OBJECT_SIZE);
+  for (int i = 0; i < objectCount; i++) {
+    double positionX = x(random);
+    double positionY = y(random);
+    manager.addDisplayable(
+        std::make_shared<Rectangle>(i, BENCH_OBJECT_SIZE, BENCH_OBJECT_SIZE,
+                                    BENCH_OBJECT_MASS, positionX, positionY));
+  }
+
+  // The first frame also creates the back buffer
+  manager.onNotified();
+  manager.sync();
+
+  unsigned long firstRequest = manager.nextRequest();
+  std::chrono::time_point<std::chrono::steady_clock> start =
+      std::chrono::steady_clock::now();
+  for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+    manager.onNotified();
+  }
+  unsigned long requests = manager.nextRequest() - firstRequest;
+  manager.sync();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  return {requests / BENCH_FRAMES, elapsed.count() / BENCH_FRAMES};
+}
+
+int main(int argc, char *argv[]) {
+  if (std::getenv("DISPLAY") == nullptr) {
+    std::fprintf(stderr, "DISPLAY is not set, run under an X server such as "
+                         "xvfb-run\n");
+    return EXIT_FAILURE;
+  }
+
+  int objectCounts[] = {1000, 10000, 50000};
+  bool fewerRequests = true;
+  for (int objectCount : objectCounts) {
+    std::printf("%d rectangles\n", objectCount);
+
+    RenderResult unbatched, batched;
+    {
+      UnbatchedXManager manager(BENCH_WINDOW_WIDTH, BENCH_WINDOW_HEIGHT, 0);
+      unbatched = run(manager, objectCount);
+    }
+    {
+      CountingXManager manager(BENCH_WINDOW_WIDTH, BENCH_WINDOW_HEIGHT, 0);
+      batched = run(manager, objectCount);
+    }
+
+    bool fewer = batched.requestsPerFrame < unbatched.requestsPerFrame;
+    fewerRequests = fewerRequests && fewer;
+    std::printf("  %-10s %8lu requests/frame %9.3f ms/frame\n", "unbatched",
+                unbatched.requestsPerFrame, unbatched.millisecondsPerFrame);
+    std::printf("  %-10s %8lu requests/frame %9.3f ms/frame%s\n", "batched",
+                batched.requestsPerFrame, batched.millisecondsPerFrame,
+                fewer ? "" : "  NOT FEWER");
+  }
+
+  return fewerRequests ? EXIT_SUCCESS : EXIT_FAILURE;
+}
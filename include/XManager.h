@@ -1,12 +1,15 @@
 #ifndef X_MANAGER_H
 #define X_MANAGER_H
 
+#include "damageRegion.h"
 #include "designPatterns.h"
 #include "gameObjects.h"
 #include "physicsEngine.h"
 #include <X11/X.h>
 #include <X11/Xlib.h>
+#include <X11/extensions/Xdbe.h>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 #define WINDOW_DEFAULT_X 0
@@ -15,10 +18,39 @@
 struct Displayable {
   bool display = True;
   std::shared_ptr<DisplayVisitable> displayable;
+  // Where the displayable was drawn on the last frame, empty if it was not
+  ScreenBounds drawnBounds;
 
   Displayable(std::shared_ptr<DisplayVisitable> &dv);
 };
 
+typedef enum {
+  // Clear and repaint the whole window every frame
+  FULL_REDRAW,
+  // Clear and repaint only where displayables moved, appeared or disappeared
+  DAMAGE_TRACKING
+} RenderMode;
+
+/**
+ * What the last frame repainted
+ */
+struct RenderStats {
+  int dirtyRectangles = 0;
+  // Share of the window repainted, from 0 to 100
+  double dirtyAreaPercentage = 0;
+  int objectsDrawn = 0;
+};
+
+/**
+ * Finds where displayables are drawn, without drawing them
+ */
+struct BoundsVisitor : VisitorDisplay {
+  double interpolationAlpha = 1;
+  ScreenBounds bounds;
+
+  void visitRectangle(const Rectangle &rectangle) override;
+};
+
 enum Key {
   NO_KEY,
   KEY_SPACE,
@@ -47,7 +79,26 @@ public:
   virtual void draw() = 0;
   virtual void erase() = 0;
 
+  /**
+   * Draw game objects this far, from 0 to 1, between their previous and
+   * current positions
+   */
+  virtual void setInterpolationAlpha(double alpha) = 0;
+
+  virtual void setRenderMode(RenderMode mode) = 0;
+  virtual RenderStats getRenderStats() = 0;
+
   virtual void handleEvents() = 0;
+  /**
+   * File descriptor that turns readable when events arrive. It changes when
+   * the window is recreated
+   */
+  virtual int getEventFD() = 0;
+  /**
+   * Send pending drawing and check for events not handled yet. Events already
+   * read from the connection do not make it readable again
+   */
+  virtual bool hasPendingEvents() = 0;
 
   virtual const std::vector<Key> &getKeyPresses() = 0;
   virtual void clearKeyPresses() = 0;
@@ -60,18 +111,31 @@ public:
 };
 
 class XManager : public DisplayManager {
-  Display *display;
-  Window window;
-  GC gc;
-  int screenNum;
+  bool doubleBufferExtension = false;
+  bool backBufferCreated = false;
+
+  // Set when the whole window has to be repainted on the next frame
+  bool fullRedraw = true;
+  BoundsVisitor boundsVisitor;
+  RenderStats renderStats;
+
+  // Rectangles visited but not filled yet. Reused across frames, so it only
+  // allocates while the scene grows
+  std::vector<XRectangle> pendingRectangles;
+  // Damaged rectangles cleared by the last frame, reused the same way
+  std::vector<XRectangle> clearedRectangles;
 
   std::vector<Key> keysPressed;
 
   std::unique_ptr<Displayable> player;
   std::vector<std::unique_ptr<Displayable>> displayables;
+  // Index of each displayable in displayables
+  std::unordered_map<DisplayVisitable *, size_t> displayableIndexes;
 
   std::vector<std::shared_ptr<Observer>> observers;
 
+  double interpolationAlpha = 1;
+
   void visitRectangle(const Rectangle &rectangle) override;
 
   void updateWindowSize();
@@ -79,15 +143,71 @@ class XManager : public DisplayManager {
   void destroyWindow();
   void createWindow();
 
+  /**
+   * Find where each displayable is drawn this frame, and add the bounds of
+   * the ones that changed to the damage
+   */
+  void trackDamage(Displayable &displayable);
+  /**
+   * Clear and repaint the damaged parts of the window only
+   */
+  void drawDamage();
+
+  /**
+   * Fill the pending rectangles in the foreground colour
+   */
+  void flushRectangles();
+
   Key convertXKtoKey(int xk_key);
   Key convertReleasedXKtoKey(int xk_key);
   void removeKeyFromKeysPressed(Key key);
   void setVisibility(std::shared_ptr<DisplayVisitable> &displayable,
                      bool visibility);
 
+protected:
+  Display *display;
+  Window window;
+  GC gc;
+  int screenNum;
+
+  RenderMode renderMode = FULL_REDRAW;
+  // Parts of the window repainted this frame, while damage tracking
+  DamageRegion damage;
+
+  // Frames are drawn off-screen into a back buffer, then shown in one go.
+  // Here the back buffer is a DBE buffer when the server has the extension,
+  // and a window-sized pixmap otherwise. Derived classes drawing elsewhere
+  // override the back buffer methods, and free their back buffer in their
+  // destructor with releaseBackBuffer
+  Drawable backBuffer;
+  int backBufferWidth, backBufferHeight;
+
+  virtual void createBackBuffer();
+  virtual void destroyBackBuffer();
+  /**
+   * @return False if the back buffer has to be recreated for the window size
+   */
+  virtual bool backBufferFits();
+  /**
+   * Show the frame drawn in the back buffer, only the damage while damage
+   * tracking
+   */
+  virtual void presentBackBuffer();
+  /**
+   * Fill rectangles of the back buffer with the pixel value
+   */
+  virtual void fillRectangles(const XRectangle *rectangles, size_t count,
+                              unsigned long pixel);
+  /**
+   * Called with the events the display manager itself does not handle
+   */
+  virtual void handleOtherEvent(const XEvent &event) {}
+
+  void releaseBackBuffer();
+
 public:
   XManager(int windowWidth, int windowHeight, int borderWidth);
-  ~XManager();
+  virtual ~XManager();
 
   int windowWidth, windowHeight, borderWidth;
 
@@ -108,7 +228,14 @@ public:
   void draw() override;
   void erase() override;
 
+  void setInterpolationAlpha(double alpha) override;
+
+  void setRenderMode(RenderMode mode) override;
+  RenderStats getRenderStats() override;
+
   void handleEvents() override;
+  int getEventFD() override;
+  bool hasPendingEvents() override;
 
   const std::vector<Key> &getKeyPresses() override;
   void clearKeyPresses() override;
@@ -0,0 +1,77 @@
+#ifndef XSHM_MANAGER_H
+#define XSHM_MANAGER_H
+
+#include "XManager.h"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <cstdint>
+#include <memory>
+
+// Pixels written at once when filling 32 bit spans
+#define PIXEL_BATCH_SIZE 8
+
+typedef uint32_t PixelBatch
+    __attribute__((vector_size(PIXEL_BATCH_SIZE * sizeof(uint32_t))));
+
+/**
+ * Display manager drawing frames in client memory rather than on the server.
+ *
+ * Rectangles are filled into an XImage, a span of pixels at a time, and the
+ * image is sent to the window once per frame. With the MIT-SHM extension the
+ * image lives in memory shared with the server, so sending it copies nothing
+ * over the connection. Without it, e.g. on a remote display, the image is
+ * sent with XPutImage.
+ */
+class XShmManager : public XManager {
+  XImage *image = nullptr;
+  XShmSegmentInfo shmInfo;
+  // True if image is shared with the server
+  bool sharedMemory = false;
+
+  // Shared images sent and not read by the server yet. The image is only
+  // drawn into once the server is done with it, so frames never tear
+  int pendingCompletions = 0;
+  int completionEventType;
+
+  /**
+   * @return False if the server cannot share memory with this client
+   */
+  bool createSharedImage(Visual *visual, int depth, int width, int height);
+  void waitForCompletion();
+
+  /**
+   * Fill rectangles through XPutPixel, for pixel formats the span fill does
+   * not handle
+   */
+  void fillRectanglesSlow(const XRectangle *rectangles, size_t count,
+                          unsigned long pixel);
+
+protected:
+  void createBackBuffer() override;
+  void destroyBackBuffer() override;
+  bool backBufferFits() override;
+  void presentBackBuffer() override;
+  void fillRectangles(const XRectangle *rectangles, size_t count,
+                      unsigned long pixel) override;
+  void handleOtherEvent(const XEvent &event) override;
+
+public:
+  XShmManager(int windowWidth, int windowHeight, int borderWidth);
+  ~XShmManager();
+
+  /**
+   * @return True if frames are sent through shared memory
+   */
+  bool isSharedMemory();
+};
+
+typedef enum { X_DRAWING, X_SHARED_MEMORY } DisplayManagerType;
+
+struct DisplayManagerFactory {
+  std::shared_ptr<DisplayManager>
+  createDisplayManager(DisplayManagerType type, int windowWidth,
+                       int windowHeight, int borderWidth);
+};
+
+#endif // !XSHM_MANAGER_H
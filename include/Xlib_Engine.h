@@ -2,14 +2,38 @@
 #define XLIB_ENGINE_H
 
 #include "XManager.h"
+#include "XShmManager.h"
+#include "frameScheduler.h"
 #include "gameObjects.h"
 #include "physicsEngine.h"
+#include "slotMap.h"
+#include "threadedDisplayManager.h"
 #include <functional>
 #include <memory>
+#include <span>
+#include <thread>
 #include <unordered_map>
 
 class GameEngine;
 
+/**
+ * Engine settings beyond the window and physics constants. The defaults keep
+ * the behaviour of the original constructor: a mock collision engine and no
+ * threads besides the event loop
+ */
+struct GameEngineOptions {
+  CollisionEngineType collisionEngineType = MOCK_COLLISIONS;
+  // Threads shared by collision detection and physics integration, including
+  // the one running the event loop
+  int threadCount = 1;
+  // X_SHARED_MEMORY to draw frames in client memory and send them through
+  // MIT-SHM, X_DRAWING to draw them on the server
+  DisplayManagerType displayManagerType = X_DRAWING;
+  // True to draw on a thread of its own, which takes a snapshot of the scene
+  // after each tick. Physics then never waits for the X server
+  bool renderThread = false;
+};
+
 struct WindowChangeObserver : Observer {
   GameEngine *gameEngine;
 
@@ -31,9 +55,11 @@ class GameEngine : Observable {
   std::shared_ptr<PhysicsEngine> physicsEngine;
 
   GameObjectFactory gameObjectFactory;
+  CollisionEngineFactory collisionEngineFactory;
+  DisplayManagerFactory displayManagerFactory;
   std::shared_ptr<GameObject> player;
-  std::vector<std::shared_ptr<GameObject>> gameObjects;
-  int gameObjectInstantiationCount = 0;
+  // Every game object, the player and sprites included, by ID
+  SlotMap<std::shared_ptr<GameObject>> gameObjects;
 
   std::unordered_map<Key, std::function<void(GameEngine &)>> keyHandlers;
 
@@ -43,6 +69,12 @@ class GameEngine : Observable {
 
   bool exitFlag;
 
+  // Sleeps between frames while no input arrives
+  FrameScheduler frameScheduler;
+
+  // Thread running the engine. Batch calls from other threads are queued
+  std::thread::id engineThread;
+
   void handleKeyPresses();
 
   std::shared_ptr<GameObject> createNewGameObject(GameObjectType type, int x,
@@ -50,27 +82,53 @@ class GameEngine : Observable {
                                                   int mass);
   std::shared_ptr<GameObject> &getObjectByID(int objectID);
 
+  void sendCommands(ObjectCommandType type, std::span<const int> objectIDs,
+                    std::span<const double> x, std::span<const double> y);
+
 public:
   GameEngine(int windowWidth, int windowHeight, int borderWidth,
              double gravitationalPull, double jumpImpulse, double walkingSpeed,
              int frameDuration, bool collisions);
+  GameEngine(int windowWidth, int windowHeight, int borderWidth,
+             double gravitationalPull, double jumpImpulse, double walkingSpeed,
+             int frameDuration, bool collisions,
+             const GameEngineOptions &options);
 
   void updateWorldSize();
+  /**
+   * Pass the physics engine's interpolation alpha on to the display
+   */
+  void updateInterpolationAlpha();
+  /**
+   * Close the frame's sleep time, called on every frame drawn
+   */
+  void endFrame();
 
   /**
    * Start the event loop.
    * On each iteration, call tick() on physicsEngine, and handleEvents() on
-   * DisplayManager
+   * DisplayManager, then sleep until input arrives or the next tick is due
    */
   void run();
   void exit();
 
+  /**
+   * Get how long the event loop slept during the last frame
+   */
+  std::chrono::nanoseconds getFrameSleepTime();
+
   void notifyAll() override;
   void addObserver(std::shared_ptr<Observer> observer) override;
   void removeObserver(std::shared_ptr<Observer> &observer) override;
 
   void setNewPlayer(GameObjectType type, int x, int y, int width, int height,
                     int mass);
+  /**
+   * Add a game object
+   *
+   * @return ID of the object, which stops naming any object once the object
+   * is removed. INVALID_HANDLE if the object could not be created
+   */
   int addNewObject(GameObjectType type, int x, int y, int width, int height,
                    int mass);
 
@@ -83,6 +141,7 @@ public:
   void playerSetXSpeed(double x);
   void playerSetYSpeed(double y);
   void playerSetSpeed(double x, double y);
+  void playerSetCollisionFilter(uint32_t category, uint32_t mask);
 
   void jumpObject(int objectID);
   void objectSetAt(int objectID, int x, int y);
@@ -90,6 +149,50 @@ public:
   void objectSetXSpeed(int objectID, double x);
   void objectSetYSpeed(int objectID, double y);
   void objectSetSpeed(int objectID, double x, double y);
+  void objectSetFast(int objectID, bool fast);
+  void objectSetRestitution(int objectID, double restitution);
+  /**
+   * Put the object in the given collision categories, and make it collide
+   * only with objects in the categories of mask
+   */
+  void objectSetCollisionFilter(int objectID, uint32_t category, uint32_t mask);
+
+  // Batched object updates, taking the IDs of the objects and parallel arrays
+  // of values. Made from the thread running the engine, they are applied at
+  // once. Made from any other thread, they are applied at the start of the
+  // next tick
+  void objectsApplyForce(std::span<const int> objectIDs,
+                         std::span<const double> x, std::span<const double> y);
+  void objectsSetSpeed(std::span<const int> objectIDs,
+                       std::span<const double> x, std::span<const double> y);
+  void objectsSetAt(std::span<const int> objectIDs, std::span<const double> x,
+                    std::span<const double> y);
+
+  void setSolverIterations(int iterations);
+  void setPhysicsStorageMode(PhysicsStorageMode mode);
+  /**
+   * Step physics stepsPerSecond times a second, whatever the frame rate. The
+   * display then draws objects interpolated between their last two steps
+   */
+  void setFixedTimestep(int stepsPerSecond, int maxCatchUpSteps);
+  void setVariableTimestep();
+  /**
+   * Choose between repainting the whole window every frame, and repainting
+   * only what changed
+   */
+  void setRenderMode(RenderMode mode);
+  RenderStats getRenderStats();
+
+  /**
+   * Save the physics state of the world, e.g. into a SnapshotRing, to roll
+   * back to later
+   */
+  void saveSnapshot(WorldSnapshot &snapshot);
+  /**
+   * @return True if restored, False if objects were added or removed since
+   * the snapshot was saved
+   */
+  bool restoreSnapshot(const WorldSnapshot &snapshot);
 
   // Player movement utilities
   void playerSetWalkingSpeed(int speed);
@@ -105,6 +208,24 @@ public:
   void setVisible(int objectID);
 
   void onKeyPressed(Key key, std::function<void(GameEngine &)> keyHandler);
+
+  // Spatial queries. Results are written to the caller's buffers, which are
+  // cleared first, so reusing them between queries avoids allocations
+  /**
+   * Get the IDs of the objects overlapping a region
+   */
+  void queryRegion(int x, int y, int width, int height,
+                   std::vector<int> &objectIDs);
+  /**
+   * Get the objects crossed by the segment from (x, y) to (x + dx, y + dy),
+   * nearest first
+   */
+  void raycast(double x, double y, double dx, double dy,
+               std::vector<RaycastHit> &hits);
+  /**
+   * Get the IDs of the k objects closest to a point, nearest first
+   */
+  void nearest(double x, double y, int k, std::vector<int> &objectIDs);
 };
 
 #endif // !XLIB_ENGINE_H
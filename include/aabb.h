@@ -0,0 +1,41 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "gameObjects.h"
+#include <algorithm>
+
+/**
+ * Axis-aligned bounding box
+ */
+struct AABB {
+  double minX, minY, maxX, maxY;
+
+  static AABB fromHitbox(const GameObject &gameObject) {
+    return {gameObject.position.x, gameObject.position.y,
+            gameObject.position.x + gameObject.hitboxWidth,
+            gameObject.position.y + gameObject.hitboxHeight};
+  }
+
+  bool overlaps(const AABB &other) const {
+    return minX < other.maxX && other.minX < maxX && minY < other.maxY &&
+           other.minY < maxY;
+  }
+
+  bool contains(const AABB &other) const {
+    return minX <= other.minX && minY <= other.minY && maxX >= other.maxX &&
+           maxY >= other.maxY;
+  }
+
+  AABB merge(const AABB &other) const {
+    return {std::min(minX, other.minX), std::min(minY, other.minY),
+            std::max(maxX, other.maxX), std::max(maxY, other.maxY)};
+  }
+
+  AABB expand(double margin) const {
+    return {minX - margin, minY - margin, maxX + margin, maxY + margin};
+  }
+
+  double perimeter() const { return 2 * ((maxX - minX) + (maxY - minY)); }
+};
+
+#endif // !AABB_H
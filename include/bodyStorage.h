@@ -0,0 +1,87 @@
+#ifndef BODY_STORAGE_H
+#define BODY_STORAGE_H
+
+#include "gameObjects.h"
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+#define BODY_SLEEPING 1
+#define BODY_FAST 2
+// Stepped since its handle was last brought up to date
+#define BODY_MOVED 4
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Allocator starting arrays on a cache line, so that chunks of whole cache
+ * lines handed to different threads never share one
+ */
+template <typename T> struct CacheLineAllocator {
+  typedef T value_type;
+
+  CacheLineAllocator() = default;
+  template <typename U> CacheLineAllocator(const CacheLineAllocator<U> &) {}
+
+  T *allocate(size_t count) {
+    return static_cast<T *>(::operator new(
+        count * sizeof(T), std::align_val_t(CACHE_LINE_SIZE)));
+  }
+  void deallocate(T *pointer, size_t) {
+    ::operator delete(pointer, std::align_val_t(CACHE_LINE_SIZE));
+  }
+
+  bool operator==(const CacheLineAllocator &) const { return true; }
+};
+
+template <typename T>
+using CacheLineVector = std::vector<T, CacheLineAllocator<T>>;
+
+/**
+ * Physics state of game objects kept in contiguous per-field arrays, so that
+ * integration walks memory linearly instead of chasing a pointer per object.
+ *
+ * Every stored object owns a dense slot, which holds its physics state while
+ * it is stored. Its GameObject is a handle, brought up to date from the slot
+ * only when something outside the arrays has to read it.
+ */
+struct BodyStorage {
+  CacheLineVector<double> positionX, positionY;
+  CacheLineVector<double> speedX, speedY;
+  CacheLineVector<double> accelerationX, accelerationY;
+  CacheLineVector<double> mass;
+  CacheLineVector<double> width, hitboxWidth, hitboxHeight;
+  CacheLineVector<double> lastPositionX, lastPositionY;
+  CacheLineVector<int> sleepFrames;
+  CacheLineVector<unsigned char> flags;
+
+  std::vector<std::shared_ptr<GameObject>> handles;
+
+  /**
+   * Give the game object a slot, filled from its current state
+   */
+  void add(const std::shared_ptr<GameObject> &gameObject);
+
+  /**
+   * Free the game object's slot, moving the last slot into it
+   */
+  void remove(GameObject &gameObject);
+
+  void clear();
+
+  /**
+   * Copy the state of a slot's handle into the slot
+   */
+  void pull(int slot);
+
+  /**
+   * Copy the position, speed, acceleration and sleep counters of a slot to
+   * its handle
+   */
+  void push(int slot);
+
+  size_t size() const { return handles.size(); }
+};
+
+#endif // !BODY_STORAGE_H
@@ -4,8 +4,22 @@
 #define GRID_COLUMNS 10
 #define GRID_ROWS 10
 #define GRID_SIZE GRID_COLUMNS *GRID_ROWS
+// Side of a grid cell, in average object sizes
+#define GRID_CELL_OBJECT_SIZES 2.0
+// Most grid cells per object, bounding the memory of sparse worlds
+#define GRID_CELLS_PER_OBJECT 4
+// Change of the object count, as a factor, that has the grid resized
+#define GRID_RESIZE_FACTOR 2
 
+#include "aabb.h"
 #include "gameObjects.h"
+#include "narrowphase.h"
+#include "threadPool.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 struct Collision {
@@ -15,7 +29,18 @@ struct Collision {
       : collider1(c1), collider2(c2) {}
 };
 
+/**
+ * Object crossed by a raycast
+ */
+struct RaycastHit {
+  int id;
+  // Fraction of the ray travelled when it enters the object's hitbox
+  double time;
+};
+
 struct CollisionEngine {
+  virtual ~CollisionEngine() = default;
+
   /**
    * Get all collisions between game objects
    *
@@ -50,8 +75,126 @@ struct CollisionEngine {
    */
   virtual void updateObjectQuadrants(std::shared_ptr<GameObject> &previousState,
                                      std::shared_ptr<GameObject> &newState) = 0;
+
+  /**
+   * Called when the size of the world changes, so that spatial structures can
+   * be resized
+   */
+  virtual void setWorldSize(int width, int height) = 0;
+
+  /**
+   * Called after the collision category or mask of an object changed, so that
+   * the filters cached by the engine are refreshed
+   */
+  virtual void updateObjectFilter(std::shared_ptr<GameObject> &gameObject) = 0;
+
+  /**
+   * Share a thread pool to spread getAllCollisions across cores. The result
+   * is the same whatever the number of threads.
+   */
+  virtual void setThreadPool(std::shared_ptr<ThreadPool> threadPool) = 0;
+
+  /**
+   * Get the objects whose hitbox overlaps a region
+   *
+   * @param result cleared and filled with the IDs of the objects
+   */
+  virtual void queryRegion(const AABB &region, std::vector<int> &result) = 0;
+
+  /**
+   * Get the objects crossed by the segment from (x, y) to (x + dx, y + dy)
+   *
+   * @param hits cleared and filled with the objects crossed, nearest first
+   */
+  virtual void raycast(double x, double y, double dx, double dy,
+                       std::vector<RaycastHit> &hits) = 0;
+
+  /**
+   * Get the k objects whose hitbox is closest to a point
+   *
+   * @param result cleared and filled with the IDs of the objects, nearest
+   * first
+   */
+  virtual void nearest(double x, double y, int k, std::vector<int> &result) = 0;
 };
 
+/**
+ * Check whether the hitboxes of two game objects overlap
+ */
+bool hitboxesOverlap(const GameObject &o1, const GameObject &o2);
+
+/**
+ * Check whether objects with the given categories and masks may collide. With
+ * categories and masks aggregated over several objects, false means that no
+ * pair among them may collide
+ */
+inline bool filtersMatch(uint32_t category1, uint32_t mask1,
+                         uint32_t category2, uint32_t mask2) {
+  return (category1 & mask2) != 0 && (category2 & mask1) != 0;
+}
+
+inline bool filtersMatch(const GameObject &o1, const GameObject &o2) {
+  return filtersMatch(o1.collisionCategory, o1.collisionMask,
+                      o2.collisionCategory, o2.collisionMask);
+}
+
+/**
+ * Split [0, itemCount) into contiguous chunks, find the collisions of each
+ * chunk on the thread pool (inline without one) and concatenate them in chunk
+ * order. Each pair must be found by a single item, so the result is the same
+ * as a serial pass over the items.
+ *
+ * @param findCollisions called with [begin, end), the chunk index and the
+ * chunk's output buffer
+ */
+std::vector<Collision> collectCollisions(
+    ThreadPool *threadPool, size_t itemCount,
+    const std::function<void(size_t, size_t, size_t, std::vector<Collision> &)>
+        &findCollisions);
+
+/**
+ * Number of chunks collectCollisions splits itemCount items into
+ */
+size_t collisionChunkCount(ThreadPool *threadPool, size_t itemCount);
+
+/**
+ * Get the time of impact of a box moving by (dx, dy) against a static box
+ *
+ * @return fraction of the displacement, in [0, 1], after which the boxes
+ * start overlapping, or 1 if they do not meet during the displacement
+ */
+double sweptTimeOfImpact(const AABB &moving, double dx, double dy,
+                         const AABB &target);
+
+/**
+ * Check whether the segment from (x, y) to (x + dx, y + dy) touches a box
+ *
+ * @param time set to the fraction of the segment at which it enters the box,
+ * 0 if it starts inside
+ */
+bool segmentHitsBox(const AABB &box, double x, double y, double dx, double dy,
+                    double &time);
+
+/**
+ * Get the squared distance from a point to a box, 0 if the point is inside
+ */
+double squaredDistanceToBox(const AABB &box, double x, double y);
+
+// Squared distance and ID of an object considered by a nearest query
+typedef std::pair<double, int> NearestCandidate;
+
+/**
+ * Offer an object to a max-heap holding the k nearest objects seen so far
+ */
+void pushNearestCandidate(std::vector<NearestCandidate> &candidates, size_t k,
+                          double squaredDistance, int id);
+
+/**
+ * Sort the candidates and write their IDs to result, nearest first
+ */
+void writeNearestCandidates(std::vector<NearestCandidate> &candidates,
+                            std::vector<int> &result);
+
 struct MockCollisionEngine : CollisionEngine {
   std::vector<Collision> getAllCollisions() override;
 
@@ -67,80 +210,459 @@ struct MockCollisionEngine : CollisionEngine {
 
   void updateObjectQuadrants(std::shared_ptr<GameObject> &previousState,
                              std::shared_ptr<GameObject> &newState) override;
+
+  void setWorldSize(int width, int height) override;
+
+  void updateObjectFilter(std::shared_ptr<GameObject> &gameObject) override;
+
+  void setThreadPool(std::shared_ptr<ThreadPool> threadPool) override;
+
+  void queryRegion(const AABB &region, std::vector<int> &result) override;
+
+  void raycast(double x, double y, double dx, double dy,
+               std::vector<RaycastHit> &hits) override;
+
+  void nearest(double x, double y, int k, std::vector<int> &result) override;
+};
+
+typedef std::vector<int> Quadrant;
+
+/**
+ * Inclusive range of grid cells covered by an object's hitbox
+ */
+struct QuadrantRange {
+  int minColumn, minRow, maxColumn, maxRow;
+
+  bool operator==(const QuadrantRange &other) const = default;
+
+  bool contains(int row, int column) const {
+    return row >= minRow && row <= maxRow && column >= minColumn &&
+           column <= maxColumn;
+  }
+};
+
+/**
+ * Engine that detects collisions between game objects using a uniform grid.
+ *
+ * Objects are kept in a dense array and every quadrant stores the indexes of
+ * the objects overlapping it, so a query only looks at the objects sharing a
+ * quadrant with the queried one.
+ *
+ * Unless given a fixed number of rows and columns, quadrants are sized from
+ * the objects: a few average object sizes wide, with no more than
+ * GRID_CELLS_PER_OBJECT quadrants per object. The grid is sized again when
+ * the object count changes by GRID_RESIZE_FACTOR, so each quadrant holds a
+ * bounded number of objects and a tick stays linear in the object count.
+ */
+struct XCollisionEngine : CollisionEngine {
+  std::vector<Quadrant> gameGrid;
+
+  // Union of the collision categories and masks of each quadrant's objects
+  std::vector<uint32_t> quadrantCategories;
+  std::vector<uint32_t> quadrantMasks;
+
+  int width, height;
+
+  int rows = GRID_ROWS;
+  int columns = GRID_COLUMNS;
+
+  /**
+   * Grid sized from the objects added
+   */
+  XCollisionEngine(int width, int height);
+
+  /**
+   * Grid with a fixed number of rows and columns
+   */
+  XCollisionEngine(int width, int height, int rows, int columns);
+
+  std::vector<Collision> getAllCollisions() override;
+
+  std::vector<std::shared_ptr<GameObject>>
+  getCollisionsWithObject(std::shared_ptr<GameObject> &gameObject) override;
+
+  bool objectsCollided(const std::shared_ptr<GameObject> &o1,
+                       const std::shared_ptr<GameObject> &o2) override;
+
+  void addGameObject(std::shared_ptr<GameObject> gameObject) override;
+
+  void removeGameObject(std::shared_ptr<GameObject> &gameObject) override;
+
+  /**
+   * Move the object between quadrants. The quadrants an object occupies are
+   * tracked by the engine, so only the quadrants it entered or left are
+   * touched, and previousState is not read.
+   */
+  void updateObjectQuadrants(std::shared_ptr<GameObject> &previousState,
+                             std::shared_ptr<GameObject> &newState) override;
+
+  void setWorldSize(int width, int height) override;
+
+  void updateObjectFilter(std::shared_ptr<GameObject> &gameObject) override;
+
+  void setThreadPool(std::shared_ptr<ThreadPool> threadPool) override;
+
+  void queryRegion(const AABB &region, std::vector<int> &result) override;
+
+  void raycast(double x, double y, double dx, double dy,
+               std::vector<RaycastHit> &hits) override;
+
+  void nearest(double x, double y, int k, std::vector<int> &result) override;
+
+private:
+  double quadrantWidth, quadrantHeight;
+  // Inverse of the quadrant sizes, so finding quadrants takes no division
+  double inverseQuadrantWidth, inverseQuadrantHeight;
+
+  bool fixedSize;
+  // Sum of the largest side of every object's hitbox when it was added
+  double objectSizeSum = 0;
+  // Object count the grid was last sized for
+  size_t sizedObjectCount = 0;
+
+  // Dense object storage, objectQuadrants[i] is the range objects[i] is in
+  std::vector<std::shared_ptr<GameObject>> objects;
+  std::vector<QuadrantRange> objectQuadrants;
+  std::unordered_map<int, int> objectIndexes;
+
+  // Used to skip objects already visited during a query
+  std::vector<unsigned int> visitedMarks;
+  unsigned int currentMark = 0;
+
+  std::shared_ptr<ThreadPool> threadPool;
+
+  // Narrowphase buffers reused between calls to getAllCollisions, one per
+  // chunk of rows
+  std::vector<AABB> objectBoxes;
+  std::vector<AABBPairBatch> candidatePairs;
+  std::vector<std::vector<CollidingPair>> collidingPairs;
+
+  std::vector<NearestCandidate> nearestCandidates;
+
+  /**
+   * Get the range of quadrants that the game object is in
+   *
+   * @param gameObject reference game object
+   * @return range of quadrants, clamped to the grid
+   */
+  QuadrantRange getObjectQuadrants(const GameObject &gameObject);
+
+  QuadrantRange getBoxQuadrants(const AABB &box);
+
+  /**
+   * Get the area covered by a quadrant. Objects outside the world are kept in
+   * the border quadrants, so those reach out to infinity
+   */
+  AABB getQuadrantBox(int row, int column);
+
+  /**
+   * Offer every object of a quadrant not visited yet to the nearest query
+   */
+  void visitNearestQuadrant(int row, int column, double x, double y, size_t k,
+                            unsigned int mark);
+
+  /**
+   * Convert a row and column pair into an index in the game grid
+   *
+   * @param row
+   * @param column
+   * @return index equivalent
+   */
+  int getQuadrantIndex(int row, int column);
+
+  void insertIntoQuadrants(int objectIndex, const QuadrantRange &range);
+  void addToQuadrant(int objectIndex, int quadrantIndex);
+  void removeFromQuadrant(int objectIndex, int quadrantIndex);
+
+  /**
+   * Recompute quadrant sizes and re-bucket every object
+   */
+  void rebuildGrid();
+
+  /**
+   * Pick the rows and columns from the world size and the objects, and
+   * rebuild the grid if they changed
+   */
+  void sizeGrid();
+
+  /**
+   * Size the grid again if the object count changed by GRID_RESIZE_FACTOR
+   * since it was last sized
+   */
+  void resizeGridIfNeeded();
+
+  /**
+   * Find the collisions reported by the quadrants of rows [firstRow, endRow)
+   */
+  void findCollisionsInRows(int firstRow, int endRow, size_t chunk,
+                            std::vector<Collision> &collisions);
+
+  unsigned int nextMark();
+};
+
+/**
+ * Endpoint of a proxy's interval on one axis
+ */
+struct SweepEndpoint {
+  double value;
+  int proxy;
+  bool isMin;
+};
+
+/**
+ * Bounds and bookkeeping of an object registered in the sweep-and-prune engine
+ */
+struct SweepProxy {
+  std::shared_ptr<GameObject> gameObject;
+  // endpointIndexes[axis][0] is the min endpoint, [axis][1] the max one
+  int endpointIndexes[2][2];
+  // Proxies overlapping this one on every sorted axis
+  std::vector<int> overlaps;
+};
+
+// Times a nearest query doubles its box before looking at every object
+#define SWEEP_NEAREST_MAX_DOUBLINGS 64
+
+/**
+ * Engine that detects collisions between game objects using incremental
+ * sweep-and-prune.
+ *
+ * Interval endpoints are kept sorted on the X axis (and optionally Y) across
+ * ticks. Objects move little between frames, so the insertion sort that
+ * restores the order only does a few swaps, and each swap updates the set of
+ * overlapping pairs. Queries read that set directly.
+ */
+struct SweepAndPruneCollisionEngine : CollisionEngine {
+  /**
+   * Engine sorting the X axis only
+   */
+  SweepAndPruneCollisionEngine();
+
+  /**
+   * @param sortYAxis also keep the Y axis sorted. Without it only the X
+   * overlaps are tracked and Y is checked when the pairs are read, which is
+   * cheaper when objects are spread along X. Sorting Y tracks every pair
+   * overlapping on Y alone, which grows with the square of the objects
+   * resting on a shared floor.
+   */
+  SweepAndPruneCollisionEngine(bool sortYAxis);
+
+  std::vector<Collision> getAllCollisions() override;
+
+  std::vector<std::shared_ptr<GameObject>>
+  getCollisionsWithObject(std::shared_ptr<GameObject> &gameObject) override;
+
+  bool objectsCollided(const std::shared_ptr<GameObject> &o1,
+                       const std::shared_ptr<GameObject> &o2) override;
+
+  void addGameObject(std::shared_ptr<GameObject> gameObject) override;
+
+  void removeGameObject(std::shared_ptr<GameObject> &gameObject) override;
+
+  void updateObjectQuadrants(std::shared_ptr<GameObject> &previousState,
+                             std::shared_ptr<GameObject> &newState) override;
+
+  void setWorldSize(int width, int height) override;
+
+  void updateObjectFilter(std::shared_ptr<GameObject> &gameObject) override;
+
+  void setThreadPool(std::shared_ptr<ThreadPool> threadPool) override;
+
+  void queryRegion(const AABB &region, std::vector<int> &result) override;
+
+  void raycast(double x, double y, double dx, double dy,
+               std::vector<RaycastHit> &hits) override;
+
+  void nearest(double x, double y, int k, std::vector<int> &result) override;
+
+private:
+  int axisCount;
+
+  std::vector<SweepEndpoint> axes[2];
+  // Longest X interval a proxy has had, bounding how far before a region
+  // the intervals overlapping it can start
+  double maxExtentX = 0;
+
+  std::shared_ptr<ThreadPool> threadPool;
+
+  std::vector<SweepProxy> proxies;
+  std::vector<int> freeProxies;
+  std::unordered_map<int, int> proxyIndexes;
+
+  // Bit i is set when the pair overlaps on axis i
+  std::unordered_map<uint64_t, unsigned char> pairAxes;
+
+  std::vector<NearestCandidate> nearestCandidates;
+
+  /**
+   * Call callback with every proxy whose X interval overlaps the region's,
+   * read off the sorted X axis
+   */
+  template <typename Callback>
+  void forEachInXRange(const AABB &region, Callback callback);
+
+  /**
+   * Move an endpoint to its new value and restore the axis order with
+   * insertion sort, updating pairs on every swap
+   */
+  void moveEndpoint(int axis, int proxy, int end, double value);
+
+  void setPairAxis(int proxy1, int proxy2, int axis, bool overlapping);
+
+  /**
+   * Move the proxy's interval on an axis, keeping min <= max throughout
+   */
+  void moveInterval(int axis, int proxy, double min, double max);
+
+  static double objectMin(const GameObject &gameObject, int axis);
+  static double objectMax(const GameObject &gameObject, int axis);
+};
+
+#define AABB_TREE_MARGIN 4.0
+// Updates of its latest displacement a leaf's box is stretched to cover
+#define AABB_TREE_DISPLACEMENT_MULTIPLIER 2.0
+// Leaves whose box has a perimeter this many times the one a fresh box would
+// have are reinserted, so objects that stopped or teleported do not keep a
+// stretched box
+#define AABB_TREE_SHRINK_RATIO 2.0
+#define AABB_TREE_NULL_NODE -1
+
+struct AABBTreeNode {
+  // Fattened box for leaves, union of the children's boxes otherwise
+  AABB box;
+
+  int parent;
+  int child1, child2;
+
+  // Leaves have height 0, free nodes -1
+  int height;
+
+  // Union of the collision categories and masks of the subtree's objects
+  uint32_t categories, masks;
+
+  std::shared_ptr<GameObject> gameObject;
+  // Position of a leaf's object when it was last updated
+  double lastX, lastY;
+
+  bool isLeaf() const { return child1 == AABB_TREE_NULL_NODE; }
+};
+
+/**
+ * Engine that detects collisions between game objects using a dynamic
+ * bounding volume hierarchy.
+ *
+ * Every object is a leaf holding its hitbox grown by a margin, and stretched
+ * along the object's displacement since its previous update. An object that
+ * moves inside that fattened box needs no tree update, so moving objects are
+ * only reinserted every few updates. One that leaves it, or whose box grew
+ * much larger than it needs, is removed and reinserted where it increases the
+ * tree's perimeter the least. Tree rotations on the way back up keep the boxes
+ * tight, so it copes with mixed object sizes that a uniform grid handles
+ * poorly.
+ */
+struct AABBTreeCollisionEngine : CollisionEngine {
+  double margin = AABB_TREE_MARGIN;
+
+  AABBTreeCollisionEngine();
+
+  AABBTreeCollisionEngine(double margin);
+
+  std::vector<Collision> getAllCollisions() override;
+
+  std::vector<std::shared_ptr<GameObject>>
+  getCollisionsWithObject(std::shared_ptr<GameObject> &gameObject) override;
+
+  bool objectsCollided(const std::shared_ptr<GameObject> &o1,
+                       const std::shared_ptr<GameObject> &o2) override;
+
+  void addGameObject(std::shared_ptr<GameObject> gameObject) override;
+
+  void removeGameObject(std::shared_ptr<GameObject> &gameObject) override;
+
+  void updateObjectQuadrants(std::shared_ptr<GameObject> &previousState,
+                             std::shared_ptr<GameObject> &newState) override;
+
+  void setWorldSize(int width, int height) override;
+
+  void updateObjectFilter(std::shared_ptr<GameObject> &gameObject) override;
+
+  void setThreadPool(std::shared_ptr<ThreadPool> threadPool) override;
+
+  void queryRegion(const AABB &region, std::vector<int> &result) override;
+
+  void raycast(double x, double y, double dx, double dy,
+               std::vector<RaycastHit> &hits) override;
+
+  void nearest(double x, double y, int k, std::vector<int> &result) override;
+
+  int getHeight();
+
+private:
+  std::vector<AABBTreeNode> nodes;
+  int root = AABB_TREE_NULL_NODE;
+  int freeNodes = AABB_TREE_NULL_NODE;
+
+  std::unordered_map<int, int> leaves;
+
+  std::shared_ptr<ThreadPool> threadPool;
+
+  // Traversal stacks reused between queries, one per chunk of
+  // getAllCollisions
+  std::vector<int> queryStack;
+  std::vector<std::vector<int>> chunkQueryStacks;
+
+  std::vector<NearestCandidate> nearestCandidates;
+
+  int allocateNode();
+  void freeNode(int node);
+
+  /**
+   * Box of a leaf: the hitbox grown by the margin, and stretched forward
+   * along each axis of the displacement (dx, dy) that exceeds the margin
+   */
+  AABB fattenBox(const AABB &hitbox, double dx, double dy);
+
+  void insertLeaf(int leaf);
+  void removeLeaf(int leaf);
+
+  /**
+   * Swap a child of node with a grandchild on the other side when that
+   * shrinks the perimeter of the subtree
+   */
+  void rotate(int node);
+
+  /**
+   * Recompute the height, box and filters of an internal node from its
+   * children
+   */
+  void refitNode(int node);
+
+  /**
+   * Recompute heights and boxes from node up to the root, rotating on the way
+   */
+  void refitAncestors(int node);
+
+  /**
+   * Call callback with every leaf whose box overlaps the given one
+   *
+   * @param filter when set, subtrees with no object that may collide with it
+   * are skipped
+   */
+  template <typename Callback>
+  void query(const AABB &box, std::vector<int> &stack, const GameObject *filter,
+             Callback callback);
+};
+
+typedef enum {
+  MOCK_COLLISIONS,
+  UNIFORM_GRID,
+  SWEEP_AND_PRUNE,
+  AABB_TREE
+} CollisionEngineType;
+
+struct CollisionEngineFactory {
+  CollisionEngine *createCollisionEngine(CollisionEngineType type,
+                                         int worldWidth, int worldHeight);
 };
 
-// typedef std::vector<std::shared_ptr<GameObject>> Quadrant;
-
-///**
-// * Engine that detects collisions between game objects
-// */
-// struct XCollisionEngine : CollisionEngine {
-//  Quadrant gameGrid[GRID_SIZE];
-//
-//  int width, height;
-//
-//  int rows = GRID_ROWS;
-//  int columns = GRID_COLUMNS;
-//
-//  XCollisionEngine(int width, int height) : width(width), height(height) {}
-//
-//  XCollisionEngine(int width, int height, int rows, int columns)
-//      : width(width), height(height), rows(rows), columns(columns) {}
-//
-//  std::vector<Collision> getAllCollisions() override;
-//
-//  std::vector<std::shared_ptr<GameObject>>
-//  getCollisionsWithObject(std::shared_ptr<GameObject> &gameObject) override;
-//
-//  bool objectsCollided(const std::shared_ptr<GameObject> &o1,
-//                       const std::shared_ptr<GameObject> &o2) override;
-//
-//  void addGameObject(std::shared_ptr<GameObject> gameObject) override;
-//
-//  void removeGameObject(std::shared_ptr<GameObject> &gameObject) override;
-//
-//  void updateObjectQuadrants(std::shared_ptr<GameObject> &previousState,
-//                             std::shared_ptr<GameObject> &newState) override;
-//
-// private:
-//  /**
-//   * Get all quadrants that the game object is in
-//   *
-//   * @param gameObject reference game object
-//   * @return vector containing all the quadrants that the gameObject is in
-//   * */
-//  const std::vector<Quadrant> *
-//  getObjectQuadrants(const std::shared_ptr<GameObject> &gameObject);
-//
-//  /**
-//   * Get all game objects that are colliding with the given object, inside the
-//   * given quadrant
-//   *
-//   * @param gameObject object against which all collisions are checked
-//   * @param quadrant quadrant to search possible colliding objects in
-//   * @return vector containing all game objects that are colliding with
-//   * gameObject inside quadrant
-//   */
-//  std::vector<std::shared_ptr<GameObject>>
-//  getCollisionsInQuadrant(const std::shared_ptr<GameObject> &gameObject,
-//                          const Quadrant &quadrant);
-//  /**
-//   * Get the indexes of the quadrants that the game object is in
-//   *
-//   * @param gameObject refernece game object
-//   * @return vector containing the quadrant indexes
-//   */
-//  std::vector<int>
-//  getObjectQuadrantsIndexes(std::shared_ptr<GameObject> &gameObject);
-//
-//  /**
-//   * Convert a row and column pair into an index in the game grid
-//   *
-//   * @param row
-//   * @param column
-//   * @return index equivalent
-//   */
-//  int getQuadrantIndex(int row, int column);
-//};
-//
 #endif // !COLLISION_ENGINE_H
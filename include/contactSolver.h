@@ -0,0 +1,108 @@
+#ifndef CONTACT_SOLVER_H
+#define CONTACT_SOLVER_H
+
+#include "gameObjects.h"
+#include "worldSnapshot.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#define CONTACT_SOLVER_ITERATIONS 8
+
+/**
+ * Touching pair of game objects, kept across frames while they stay in
+ * contact
+ */
+struct Contact {
+  std::shared_ptr<GameObject> body1, body2;
+
+  // Unit axis pointing from body1 to body2, and how deep they overlap on it
+  double normalX = 0, normalY = 0;
+  double penetration = 0;
+
+  // Sum of the impulses applied along the normal, reused to warm-start the
+  // next frame
+  double normalImpulse = 0;
+
+  // Speed along the normal the solver aims for, set up from restitution
+  double velocityBias = 0;
+  double normalMass = 0;
+
+  bool touched = false;
+};
+
+/**
+ * Sequential impulse solver for collisions between game objects.
+ *
+ * Contacts are cached by the IDs of their objects. A contact found again on
+ * the next frame starts from the impulse it ended with, so resting stacks
+ * need only a few iterations to settle. Contacts are solved in the order of
+ * their IDs, so results do not depend on how the cache was filled.
+ */
+struct ContactSolver {
+  /**
+   * Record that two objects collided this frame
+   */
+  void addContact(const std::shared_ptr<GameObject> &o1,
+                  const std::shared_ptr<GameObject> &o2);
+
+  /**
+   * Forget every contact involving the object
+   */
+  void removeContacts(int objectID);
+
+  /**
+   * Resolve the contacts recorded this frame, changing the speed and position
+   * of the objects, then drop the contacts that were not recorded. Contacts
+   * between sleeping objects are kept as they are
+   *
+   * @param iterations number of passes over the contacts
+   */
+  void solve(int iterations);
+
+  size_t getContactCount() { return contacts.size(); }
+
+  /**
+   * Append a snapshot of every cached contact to snapshots
+   */
+  void saveContacts(std::vector<ContactSnapshot> &snapshots);
+
+  /**
+   * Forget every contact
+   */
+  void clearContacts();
+
+  /**
+   * Cache the contact of a snapshot between its two objects
+   */
+  void restoreContact(const ContactSnapshot &snapshot,
+                      const std::shared_ptr<GameObject> &o1,
+                      const std::shared_ptr<GameObject> &o2);
+
+  /**
+   * Get the contacts resolved by the last call to solve
+   */
+  const std::vector<Contact *> &getActiveContacts() { return active; }
+
+private:
+  std::unordered_map<uint64_t, Contact> contacts;
+
+  // Contacts being solved this frame, reused between calls to solve
+  std::vector<Contact *> active;
+  // Active contacts with their key, sorted without reading the contacts
+  std::vector<std::pair<uint64_t, Contact *>> activeKeys;
+
+  /**
+   * Compute the normal and depth of the contact from its objects' hitboxes
+   *
+   * @return false when the hitboxes are apart
+   */
+  bool updateGeometry(Contact &contact);
+
+  static void applyImpulse(Contact &contact, double impulse);
+
+  static double inverseMass(const GameObject &gameObject);
+};
+
+#endif // !CONTACT_SOLVER_H
@@ -0,0 +1,50 @@
+#ifndef DAMAGE_REGION_H
+#define DAMAGE_REGION_H
+
+#include <vector>
+
+// Most rectangles a damage region is split into. Past that, damage is merged
+// into the rectangle it grows the least
+#define DAMAGE_MAX_RECTANGLES 16
+
+/**
+ * Area of the screen in pixels, empty when width or height is 0
+ */
+struct ScreenBounds {
+  int x = 0, y = 0;
+  int width = 0, height = 0;
+
+  bool empty() const { return width <= 0 || height <= 0; }
+  long area() const { return empty() ? 0 : (long)width * height; }
+
+  bool intersects(const ScreenBounds &bounds) const;
+  ScreenBounds unite(const ScreenBounds &bounds) const;
+  ScreenBounds intersect(const ScreenBounds &bounds) const;
+
+  bool operator==(const ScreenBounds &bounds) const = default;
+};
+
+/**
+ * Parts of the screen that changed since the last frame, kept as a few
+ * rectangles that never overlap
+ */
+class DamageRegion {
+  std::vector<ScreenBounds> rectangles;
+
+public:
+  void add(ScreenBounds bounds);
+  void clear();
+
+  /**
+   * Cut the rectangles down to bounds, dropping the ones outside
+   */
+  void clip(const ScreenBounds &bounds);
+
+  bool empty() const { return rectangles.empty(); }
+  long area() const;
+  bool intersects(const ScreenBounds &bounds) const;
+
+  const std::vector<ScreenBounds> &getRectangles() const { return rectangles; }
+};
+
+#endif // !DAMAGE_REGION_H
@@ -0,0 +1,47 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <chrono>
+
+/**
+ * Puts the event loop to sleep until events arrive or the next frame is due,
+ * and measures how long it slept.
+ *
+ * Deadlines are kept by a timerfd, so the loop wakes on time to the
+ * nanosecond rather than to the millisecond of a poll timeout.
+ */
+class FrameScheduler {
+  // -1 if no timerfd could be created, poll timeouts are used instead
+  int timerFD;
+
+  std::chrono::nanoseconds sleptThisFrame{0};
+  std::chrono::nanoseconds lastFrameSleep{0};
+
+public:
+  FrameScheduler();
+  ~FrameScheduler();
+
+  FrameScheduler(const FrameScheduler &) = delete;
+  FrameScheduler &operator=(const FrameScheduler &) = delete;
+
+  /**
+   * Sleep until eventFD is readable or timeout has passed. Returns at once
+   * when timeout is 0
+   *
+   * @param eventFD file descriptor to watch, -1 to only wait for the timeout
+   */
+  void waitFor(int eventFD, std::chrono::nanoseconds timeout);
+
+  /**
+   * Mark the end of a frame, making the time slept since the last mark the
+   * sleep time of that frame
+   */
+  void endFrame();
+
+  /**
+   * Get how long the loop slept during the last frame
+   */
+  std::chrono::nanoseconds getFrameSleepTime();
+};
+
+#endif // !FRAME_SCHEDULER_H
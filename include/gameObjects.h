@@ -3,8 +3,12 @@
 
 #include "designPatterns.h"
 #include "physics.h"
+#include <cstdint>
 #include <memory>
 
+#define COLLISION_CATEGORY_DEFAULT 1u
+#define COLLISION_MASK_ALL 0xFFFFFFFFu
+
 struct Rectangle;
 
 struct GameObject : DisplayVisitable {
@@ -24,8 +28,37 @@ struct GameObject : DisplayVisitable {
   double hitboxWidth;
   double hitboxHeight;
 
+  // Fast objects are swept between frames so they cannot tunnel through others
+  bool fast = false;
+
+  // Fraction of the closing speed kept when bouncing off another object
+  double restitution = 0;
+
+  // Two objects collide only when each one's category shares a bit with the
+  // other's mask
+  uint32_t collisionCategory = COLLISION_CATEGORY_DEFAULT;
+  uint32_t collisionMask = COLLISION_MASK_ALL;
+
+  // Sleeping objects are skipped by the physics engine until woken up
+  bool sleeping = false;
+  // Frames in a row the object barely moved, and where it was on the last one
+  int sleepFrames = 0;
+  physics::Position2D lastPosition;
+  // ID of the object's island while sleeping, scratch index while islands are
+  // built
+  int island = -1;
+
+  // Slot of the object in the physics engine's body storage, -1 when its
+  // state lives in this object only
+  int slot = -1;
+
+  // Position before the last fixed physics step, drawn from when the display
+  // interpolates between steps
+  physics::Position2D previousPosition;
+
   GameObject(int id)
-      : id(id), position(0, 0), speed(0, 0), acceleration(0, 0) {}
+      : id(id), position(0, 0), speed(0, 0), acceleration(0, 0),
+        lastPosition(0, 0), previousPosition(0, 0) {}
   GameObject(int id, double width, double height, double mass);
   GameObject(int id, double width, double height, double mass, double x,
              double y);
@@ -0,0 +1,50 @@
+#ifndef NARROWPHASE_H
+#define NARROWPHASE_H
+
+#include "aabb.h"
+#include <vector>
+
+/**
+ * Candidate pairs of boxes stored as packed arrays, one per coordinate, so
+ * that several pairs can be tested with a single SIMD instruction
+ */
+struct AABBPairBatch {
+  std::vector<double> minX1, minY1, maxX1, maxY1;
+  std::vector<double> minX2, minY2, maxX2, maxY2;
+
+  // Caller defined indexes reported back for colliding pairs
+  std::vector<int> index1, index2;
+
+  void add(const AABB &box1, int i1, const AABB &box2, int i2);
+  void clear();
+  void reserve(size_t size);
+  size_t size() const { return index1.size(); }
+};
+
+struct CollidingPair {
+  int index1, index2;
+};
+
+typedef enum { SCALAR_KERNEL, SSE2_KERNEL, AVX2_KERNEL } NarrowphaseKernel;
+
+/**
+ * Get the fastest kernel supported by the CPU running the program
+ */
+NarrowphaseKernel detectNarrowphaseKernel();
+
+/**
+ * Test every pair of the batch for overlap, using the fastest kernel the CPU
+ * supports
+ *
+ * @param batch candidate pairs
+ * @param result cleared and filled with the indexes of the overlapping pairs,
+ * in batch order
+ */
+void findOverlappingPairs(const AABBPairBatch &batch,
+                          std::vector<CollidingPair> &result);
+
+void findOverlappingPairs(const AABBPairBatch &batch,
+                          std::vector<CollidingPair> &result,
+                          NarrowphaseKernel kernel);
+
+#endif // !NARROWPHASE_H
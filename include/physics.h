@@ -1,77 +1,120 @@
 #ifndef PHYSICS_H
 #define PHYSICS_H
 
-namespace physics {
-struct Vector2D {
-  double x;
-  double y;
-
-  Vector2D(double x, double y) : x(x), y(y) {}
-};
-
-struct Force2D : Vector2D {
-  Force2D(double x, double y) : Vector2D(x, y) {}
-  template <typename V>
-  Force2D(const V &vector) : Force2D(vector.x, vector.y) {}
-
-  Force2D operator+(const Force2D &vector);
-  Force2D operator-(const Force2D &vector);
-  Force2D operator*(const double &scalar) const;
-  Force2D operator/(const double &scalar) const;
-
-  Force2D &operator+=(const Force2D &other);
-  Force2D &operator-=(const Force2D &other);
-  Force2D &operator*=(const double &scalar);
-  Force2D &operator/=(const double &scalar);
-};
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <type_traits>
 
-struct Acceleration2D : Vector2D {
-  Acceleration2D(double x, double y) : Vector2D(x, y) {}
-  template <typename V>
-  Acceleration2D(const V &vector) : Acceleration2D(vector.x, vector.y) {}
+// Physics math sits in the innermost loops, so it is kept inline even in
+// unoptimized builds
+#define PHYSICS_INLINE [[gnu::always_inline]] inline
 
-  Acceleration2D operator+(const Acceleration2D &vector);
-  Acceleration2D operator-(const Acceleration2D &vector);
-  Acceleration2D operator*(const double &scalar);
-  Acceleration2D operator/(const double &scalar);
+// Scalars handled per iteration by the batch helpers
+#define PHYSICS_BATCH_LANES 4
 
-  Acceleration2D &operator+=(const Acceleration2D &other);
-  Acceleration2D &operator-=(const Acceleration2D &other);
-  Acceleration2D &operator*=(const double &scalar);
-  Acceleration2D &operator/=(const double &scalar);
-};
-
-struct Speed2D : Vector2D {
-  Speed2D(double x, double y) : Vector2D(x, y) {}
-  template <typename V>
-  Speed2D(const V &vector) : Speed2D(vector.x, vector.y) {}
-
-  Speed2D operator+(const Speed2D &vector);
-  Speed2D operator-(const Speed2D &vector);
-  Speed2D operator*(const double &scalar);
-  Speed2D operator/(const double &scalar);
+namespace physics {
 
-  Speed2D &operator+=(const Speed2D &other);
-  Speed2D &operator-=(const Speed2D &other);
-  Speed2D &operator*=(const double &scalar);
-  Speed2D &operator/=(const double &scalar);
+/**
+ * Two dimensional vector of scalar T. Unit is an empty tag that keeps forces,
+ * speeds, accelerations and positions apart at no runtime cost, so mixing
+ * units takes an explicit conversion
+ */
+template <typename T, typename Unit> struct Vector2D {
+  T x;
+  T y;
+
+  PHYSICS_INLINE constexpr Vector2D(T x, T y) : x(x), y(y) {}
+
+  template <typename OtherUnit>
+  PHYSICS_INLINE constexpr explicit Vector2D(
+      const Vector2D<T, OtherUnit> &vector)
+      : x(vector.x), y(vector.y) {}
+
+  PHYSICS_INLINE constexpr Vector2D operator+(Vector2D vector) const {
+    return Vector2D(x + vector.x, y + vector.y);
+  }
+  PHYSICS_INLINE constexpr Vector2D operator-(Vector2D vector) const {
+    return Vector2D(x - vector.x, y - vector.y);
+  }
+  PHYSICS_INLINE constexpr Vector2D operator*(T scalar) const {
+    return Vector2D(x * scalar, y * scalar);
+  }
+  PHYSICS_INLINE constexpr Vector2D operator/(T scalar) const {
+    return Vector2D(x / scalar, y / scalar);
+  }
+
+  PHYSICS_INLINE constexpr Vector2D &operator+=(Vector2D vector) {
+    x += vector.x;
+    y += vector.y;
+    return *this;
+  }
+  PHYSICS_INLINE constexpr Vector2D &operator-=(Vector2D vector) {
+    x -= vector.x;
+    y -= vector.y;
+    return *this;
+  }
+  PHYSICS_INLINE constexpr Vector2D &operator*=(T scalar) {
+    x *= scalar;
+    y *= scalar;
+    return *this;
+  }
+  PHYSICS_INLINE constexpr Vector2D &operator/=(T scalar) {
+    x /= scalar;
+    y /= scalar;
+    return *this;
+  }
 };
 
-struct Position2D : Vector2D {
-  Position2D(double x, double y) : Vector2D(x, y) {}
-  template <typename V>
-  Position2D(const V &vector) : Position2D(vector.x, vector.y) {}
-
-  Position2D operator+(const Position2D &vector);
-  Position2D operator-(const Position2D &vector);
-  Position2D operator*(const double &scalar);
-  Position2D operator/(const double &scalar);
-
-  Position2D &operator+=(const Position2D &other);
-  Position2D &operator-=(const Position2D &other);
-  Position2D &operator*=(const double &scalar);
-  Position2D &operator/=(const double &scalar);
-};
+struct ForceUnit;
+struct AccelerationUnit;
+struct SpeedUnit;
+struct PositionUnit;
+
+typedef Vector2D<double, ForceUnit> Force2D;
+typedef Vector2D<double, AccelerationUnit> Acceleration2D;
+typedef Vector2D<double, SpeedUnit> Speed2D;
+typedef Vector2D<double, PositionUnit> Position2D;
+
+// Packed group of scalars, mapped by the compiler to SIMD registers
+template <typename T>
+using Batch [[gnu::vector_size(PHYSICS_BATCH_LANES * sizeof(T))]] = T;
+
+/**
+ * y[i] += a * x[i]
+ */
+template <typename T>
+PHYSICS_INLINE void axpy(T a, std::type_identity_t<std::span<const T>> x,
+                         std::type_identity_t<std::span<T>> y) {
+  size_t i = 0;
+  for (; i + PHYSICS_BATCH_LANES <= y.size(); i += PHYSICS_BATCH_LANES) {
+    Batch<T> xs, ys;
+    std::memcpy(&xs, &x[i], sizeof(xs));
+    std::memcpy(&ys, &y[i], sizeof(ys));
+    ys += a * xs;
+    std::memcpy(&y[i], &ys, sizeof(ys));
+  }
+  for (; i < y.size(); i++) {
+    y[i] += a * x[i];
+  }
+}
+
+/**
+ * y[i] += a
+ */
+template <typename T>
+PHYSICS_INLINE void addScalar(T a, std::type_identity_t<std::span<T>> y) {
+  size_t i = 0;
+  for (; i + PHYSICS_BATCH_LANES <= y.size(); i += PHYSICS_BATCH_LANES) {
+    Batch<T> ys;
+    std::memcpy(&ys, &y[i], sizeof(ys));
+    ys += a;
+    std::memcpy(&y[i], &ys, sizeof(ys));
+  }
+  for (; i < y.size(); i++) {
+    y[i] += a;
+  }
+}
 
 } // namespace physics
 
@@ -1,14 +1,47 @@
 #ifndef PHYSICS_ENGINE_H
 #define PHYSICS_ENGINE_H
 
+#include "bodyStorage.h"
 #include "collisionEngine.h"
+#include "contactSolver.h"
 #include "designPatterns.h"
 #include "gameObjects.h"
 #include "physics.h"
+#include "threadPool.h"
+#include "worldSnapshot.h"
 #include <chrono>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+typedef enum {
+  // Physics state is read from and written to each GameObject
+  OBJECT_STORAGE,
+  // Physics state lives in per-field arrays, copied to each GameObject when
+  // it is read
+  ARRAY_STORAGE
+} PhysicsStorageMode;
+
+typedef enum {
+  COMMAND_APPLY_FORCE,
+  COMMAND_SET_SPEED,
+  COMMAND_SET_POSITION
+} ObjectCommandType;
+
+/**
+ * Change to one game object or the player, applied in bulk with others and
+ * through the same calls as one at a time. Objects are named by ID, so
+ * commands for objects removed in the meantime are dropped
+ */
+struct ObjectCommand {
+  ObjectCommandType type;
+  int objectID;
+  double x, y;
+};
+
 struct PhysicsEngine : Observable {
   // Add game objects
   virtual void setPlayer(std::shared_ptr<GameObject> player) = 0;
@@ -50,6 +83,32 @@ struct PhysicsEngine : Observable {
   objectUpdateCoordinates(std::shared_ptr<GameObject> &gameObject) = 0;
   virtual void objectApplyGravity(std::shared_ptr<GameObject> &gameObject) = 0;
   virtual void objectApplyFloorFriction(std::shared_ptr<GameObject> &gameObject) = 0;
+  /**
+   * Flag the game object as fast. When collisions are on, fast objects are
+   * swept along their path in sub-steps and stopped at their time of impact,
+   * so they cannot pass through other objects
+   */
+  virtual void setObjectFast(std::shared_ptr<GameObject> &gameObject,
+                             bool fast) = 0;
+  virtual void setObjectRestitution(std::shared_ptr<GameObject> &gameObject,
+                                    double restitution) = 0;
+  /**
+   * Set the collision category bits of the game object, and the categories
+   * it collides with
+   */
+  virtual void setObjectCollisionFilter(std::shared_ptr<GameObject> &gameObject,
+                                        uint32_t category, uint32_t mask) = 0;
+
+  /**
+   * Apply commands in one pass, ordered by where their objects are stored.
+   * Commands for the same object keep their order
+   */
+  virtual void applyCommands(std::span<const ObjectCommand> commands) = 0;
+  /**
+   * Queue commands to be applied at the start of the next tick. Unlike every
+   * other call, safe to make from any thread
+   */
+  virtual void queueCommands(std::span<const ObjectCommand> commands) = 0;
 
   // Player movement utilities
   virtual void playerSetWalkingSpeed(double speed) = 0;
@@ -58,11 +117,97 @@ struct PhysicsEngine : Observable {
   virtual void playerSetWalkingRight() = 0;
   virtual void playerUnsetWalkingRight() = 0;
 
+  /**
+   * Set how many passes the collision solver makes over the contacts every
+   * frame. More passes settle stacks of objects faster but take longer
+   */
+  virtual void setSolverIterations(int iterations) = 0;
+
+  /**
+   * Choose where the physics state of game objects is kept while ticking.
+   * Array storage integrates all awake objects in one linear pass, which pays
+   * off with many objects
+   */
+  virtual void setStorageMode(PhysicsStorageMode mode) = 0;
+  /**
+   * Bring game objects up to date with the physics state. With array storage
+   * and collisions off, steps leave game objects and the collision engine
+   * behind. Notifying observers, spatial queries, snapshots and calls on an
+   * object do this first; anything else reading game objects has to call it
+   */
+  virtual void syncObjects() = 0;
+
+  /**
+   * Integrate game objects in chunks across the threads of the pool, then move
+   * them between quadrants on the calling thread. With collisions on, the
+   * collision engine then finds every collision of the step at once, spread
+   * over the same pool, instead of each object looking for its own as it
+   * moves. Collisions are then found between the final positions of the step,
+   * so results differ from a world without a pool, but not with the number
+   * of threads. Fast objects are still swept one by one
+   */
+  virtual void setThreadPool(std::shared_ptr<ThreadPool> threadPool) = 0;
+
+  /**
+   * Step the world at a fixed rate, however often tick is called. Time left
+   * over between steps is carried to the next tick
+   *
+   * @param stepsPerSecond physics step rate
+   * @param maxCatchUpSteps most steps a single tick runs to catch up, time
+   * beyond that is dropped
+   */
+  virtual void setFixedTimestep(int stepsPerSecond, int maxCatchUpSteps) = 0;
+  /**
+   * Step the world once per frame by the time the frame took
+   */
+  virtual void setVariableTimestep() = 0;
+  /**
+   * Get how far the carried over time is into the next fixed step, from 0 to
+   * 1. Drawing game objects that far between their previous and current
+   * positions hides the steps. Always 1 with a variable timestep
+   */
+  virtual double getInterpolationAlpha() = 0;
+
   virtual void tick() = 0;
+  /**
+   * Get how long until tick next has work to do, 0 if it is already due
+   */
+  virtual std::chrono::nanoseconds getTimeUntilNextTick() = 0;
+  /**
+   * Apply the queued commands and update game objects by the given time right
+   * away, whatever the clock says. For worlds simulated without a display
+   */
+  virtual void stepBy(double milliseconds) = 0;
+
+  /**
+   * Save the state of the world, reusing the memory of the snapshot
+   */
+  virtual void saveSnapshot(WorldSnapshot &snapshot) = 0;
+  /**
+   * Put the world back in the state of the snapshot. The world has to hold the
+   * same player and game objects as when the snapshot was saved
+   *
+   * Restoring and stepping 8 frames again fits in a 16 ms frame with
+   * collisions off: about 5 ms for 5000 objects, 1 ms with array storage.
+   * With collisions on, the steps cost what the broad phase and the contact
+   * solver do. For 5000 objects on the uniform grid it takes 15 to 18 ms, so
+   * the frame budget is only met at best. The sweep and prune takes about
+   * 37 ms and the AABB tree about 58 ms
+   *
+   * @return True if the snapshot was restored, False, changing nothing, if the
+   * objects differ
+   */
+  virtual bool restoreSnapshot(const WorldSnapshot &snapshot) = 0;
 
   virtual void setWorldSize(int width, int height) = 0;
   virtual int getWorldWidth() = 0;
   virtual int getWorldHeight() = 0;
+
+  // Spatial queries, answered by the collision engine
+  virtual void queryRegion(const AABB &region, std::vector<int> &result) = 0;
+  virtual void raycast(double x, double y, double dx, double dy,
+                       std::vector<RaycastHit> &hits) = 0;
+  virtual void nearest(double x, double y, int k, std::vector<int> &result) = 0;
 };
 
 struct XPhysicsEngine : PhysicsEngine {
@@ -82,10 +227,22 @@ struct XPhysicsEngine : PhysicsEngine {
 private:
   std::chrono::time_point<std::chrono::high_resolution_clock> frameStartTime;
   std::chrono::time_point<std::chrono::high_resolution_clock> frameEndTime;
-  std::chrono::milliseconds frameTimeElapsed;
+  // Time simulated by the current step
+  std::chrono::duration<double, std::milli> frameTimeElapsed;
+
+  bool fixedTimestep = false;
+  std::chrono::nanoseconds fixedStepDuration;
+  int maxCatchUpSteps = 1;
+  std::chrono::time_point<std::chrono::steady_clock> lastStepTime;
+  std::chrono::time_point<std::chrono::steady_clock> lastDrawTime;
+  // Time not simulated yet, always less than a step between ticks
+  std::chrono::nanoseconds accumulator;
+  double interpolationAlpha = 1;
 
   std::shared_ptr<GameObject> player;
   std::vector<std::shared_ptr<GameObject>> gameObjects;
+  // Index of each game object in gameObjects, by ID
+  std::unordered_map<int, size_t> objectIndexes;
 
   bool playerWalkingLeft = false;
   bool playerWalkingRight = false;
@@ -95,6 +252,39 @@ private:
   std::unique_ptr<CollisionEngine> collisionEngine;
   bool collisions = false;
 
+  ContactSolver contactSolver;
+  int solverIterations = CONTACT_SOLVER_ITERATIONS;
+
+  PhysicsStorageMode storageMode = OBJECT_STORAGE;
+  BodyStorage bodies;
+  // Whether bodies were stepped without updating their game objects
+  bool bodiesAhead = false;
+  // Body flags as they were when the tick started, reused every tick
+  std::vector<unsigned char> tickFlags;
+  // Buffers reused by every sweep of a fast object
+  std::vector<int> sweepColliders;
+  std::vector<std::pair<double, std::shared_ptr<GameObject> *>> sweepHits;
+
+  std::shared_ptr<ThreadPool> threadPool;
+
+  // Commands queued from other threads, and the ones being applied
+  std::mutex commandMutex;
+  std::vector<ObjectCommand> queuedCommands;
+  std::vector<ObjectCommand> pendingCommands;
+  // Storage position and index of each command being applied, to sort them
+  std::vector<std::pair<size_t, size_t>> commandOrder;
+
+  // Islands of objects put to sleep together, by island ID
+  std::unordered_map<int, std::vector<std::shared_ptr<GameObject>>>
+      sleepingIslands;
+  int nextIslandID = 0;
+
+  // Buffers reused to build the islands of awake objects every frame
+  std::vector<std::shared_ptr<GameObject> *> awakeObjects;
+  std::vector<int> islandParents;
+  std::vector<int> islandSleepFrames;
+  std::vector<int> islandIDs;
+
 public:
   XPhysicsEngine(double gravityPull, double jumpImpulse, double walkingSpeed,
                  int worldWidth, int worldHeight, int frameTimeDuration,
@@ -140,6 +330,14 @@ public:
   objectUpdateCoordinates(std::shared_ptr<GameObject> &gameObject) override;
   void objectApplyGravity(std::shared_ptr<GameObject> &gameObject) override;
   void objectApplyFloorFriction(std::shared_ptr<GameObject> &gameObject) override;
+  void setObjectFast(std::shared_ptr<GameObject> &gameObject,
+                     bool fast) override;
+  void setObjectRestitution(std::shared_ptr<GameObject> &gameObject,
+                            double restitution) override;
+  void setObjectCollisionFilter(std::shared_ptr<GameObject> &gameObject,
+                                uint32_t category, uint32_t mask) override;
+  void applyCommands(std::span<const ObjectCommand> commands) override;
+  void queueCommands(std::span<const ObjectCommand> commands) override;
 
   // Player movement utilities
   void playerSetWalkingSpeed(double speed) override;
@@ -151,6 +349,13 @@ public:
   // Collisions
   void setCollisionsOn();
   void setCollisionsOff();
+  void setSolverIterations(int iterations) override;
+  void setStorageMode(PhysicsStorageMode mode) override;
+  void syncObjects() override;
+  void setThreadPool(std::shared_ptr<ThreadPool> threadPool) override;
+  void setFixedTimestep(int stepsPerSecond, int maxCatchUpSteps) override;
+  void setVariableTimestep() override;
+  double getInterpolationAlpha() override;
 
   // Observable pattern
   void addObserver(std::shared_ptr<Observer> observer) override;
@@ -163,13 +368,24 @@ public:
    * Count frame time elapse. On frameTimeElapsed >= frameTimeDuration a
    * frame has passed and frameStartTime is reset.
    * On each frame, update game objects and notify all observers.
+   * With a fixed timestep, game objects are instead updated once per elapsed
+   * step, and observers are notified every frameTimeDuration.
    */
   void tick() override;
+  std::chrono::nanoseconds getTimeUntilNextTick() override;
+  void stepBy(double milliseconds) override;
+  void saveSnapshot(WorldSnapshot &snapshot) override;
+  bool restoreSnapshot(const WorldSnapshot &snapshot) override;
 
   void setWorldSize(int width, int height) override;
   int getWorldWidth() override;
   int getWorldHeight() override;
 
+  void queryRegion(const AABB &region, std::vector<int> &result) override;
+  void raycast(double x, double y, double dx, double dy,
+               std::vector<RaycastHit> &hits) override;
+  void nearest(double x, double y, int k, std::vector<int> &result) override;
+
 private:
   bool isTouchingCeilling(std::shared_ptr<GameObject> &gameObject);
   bool isTouchingFloor(std::shared_ptr<GameObject> &gameObject);
@@ -184,8 +400,119 @@ private:
   void reboundFromYAxis(std::shared_ptr<GameObject> &gameObject);
   void reboundFromXAxis(std::shared_ptr<GameObject> &gameObject);
 
+  /**
+   * Update the player and game objects by frameTimeElapsed
+   */
+  void step();
+
+  /**
+   * Run the fixed steps that fit in the time elapsed since the last tick
+   */
+  void tickFixed();
+
+  /**
+   * Move the game object by its speed and acceleration, and keep it inside
+   * the world. Unless the object is swept, touches nothing but the object
+   */
+  void integrateObject(std::shared_ptr<GameObject> &gameObject);
+
+  /**
+   * Update the awake game objects, integrating them in parallel when that
+   * gives the same results
+   */
+  void tickObjects();
+
+  /**
+   * Run gravity, integration, borders and friction over the body storage.
+   * With collisions on, bodies are then copied to their game objects one by
+   * one to find their collisions
+   */
+  void tickBodies();
+
+  /**
+   * Run gravity, integration, borders and friction over the awake bodies of
+   * the slots [begin, end), one stretch of consecutive awake slots at a time
+   */
+  void integrateBodies(size_t begin, size_t end);
+  /**
+   * Integrate the body slots [begin, end), which are all awake
+   */
+  void integrateAwakeBodies(size_t begin, size_t end);
+
+  /**
+   * Split count items in chunks of whole cache lines and run task(begin, end)
+   * on each, across the thread pool when there is one
+   */
+  void forEachChunk(size_t count,
+                    const std::function<void(size_t, size_t)> &task);
+
+  /**
+   * Copy the state of a game object into its body slot after it was changed,
+   * when it has one
+   */
+  void syncBody(GameObject &gameObject);
+  /**
+   * Copy the game object's slot back to it, and move it between quadrants, if
+   * the slot was stepped since. Called before changing a stored game object
+   */
+  void syncObject(GameObject &gameObject);
+
+  void detectCollisions(std::shared_ptr<GameObject> &gameObject);
+  /**
+   * Add a contact for every overlapping pair of objects, one of them awake,
+   * found by the collision engine in a single pass over the world
+   */
+  void detectAllCollisions();
+
+  /**
+   * Move a fast game object by displacement in sub-steps, stopping it at the
+   * time of impact with the first object it runs into
+   */
+  void sweepObject(std::shared_ptr<GameObject> &gameObject,
+                   physics::Position2D displacement);
+
+  /**
+   * Record the contact between two colliding objects, to be resolved at the
+   * end of the frame
+   */
   void onCollision(std::shared_ptr<GameObject> &go1,
                    std::shared_ptr<GameObject> &go2);
+
+  /**
+   * Resolve the contacts recorded this frame and move the objects the solver
+   * pushed apart between quadrants
+   */
+  void resolveCollisions();
+
+  /**
+   * Group awake objects into islands of objects in contact, and put to sleep
+   * the islands whose objects all stayed still for long enough
+   */
+  void updateSleeping();
+
+  /**
+   * Count the frames each awake body has stayed still and put to sleep the
+   * ones still for long enough, reading only the body arrays. Without
+   * contacts every body is an island of its own
+   */
+  void updateSleepingBodies();
+
+  int findIsland(int index);
+
+  /**
+   * Wake up the island of a sleeping game object
+   */
+  void wakeObject(GameObject &gameObject);
+
+  /**
+   * Apply the commands queued since the last tick
+   */
+  void applyQueuedCommands();
+
+  /**
+   * Game object with the given ID, the player included
+   */
+  std::shared_ptr<GameObject> *findObject(int objectID);
 };
 
 #endif // !PHYSICS_ENGINE_H
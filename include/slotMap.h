@@ -0,0 +1,121 @@
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Handles keep the slot index in their low bits and the slot's generation in
+// the bits above, leaving the sign bit clear
+#define HANDLE_INDEX_BITS 20
+#define HANDLE_GENERATION_BITS 11
+#define HANDLE_INDEX_MASK ((1 << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GENERATION_MASK ((1 << HANDLE_GENERATION_BITS) - 1)
+#define INVALID_HANDLE -1
+
+/**
+ * Values addressed by generational handles, with constant time insertion,
+ * lookup and removal.
+ *
+ * A handle names a slot and the generation the slot was in when the handle
+ * was given out. Erasing a value moves its slot to the next generation, so
+ * old handles to it are told apart from handles to whatever reuses the slot.
+ * Values stay contiguous: the last one is moved into the hole left by an
+ * erased one.
+ */
+template <typename T> class SlotMap {
+  struct Slot {
+    int generation = 0;
+    // Index of the slot's value, -1 while the slot is free
+    int valueIndex = -1;
+  };
+
+  std::vector<Slot> slots;
+  // Freed slots are reused oldest first, so generations wrap around as late
+  // as possible
+  std::deque<int> freeSlots;
+
+  std::vector<T> values;
+  // Handle of each value, to fix up its slot when the value is moved
+  std::vector<int> valueHandles;
+
+  static int handleIndex(int handle) { return handle & HANDLE_INDEX_MASK; }
+  static int handleGeneration(int handle) {
+    return (handle >> HANDLE_INDEX_BITS) & HANDLE_GENERATION_MASK;
+  }
+
+public:
+  /**
+   * Store a value
+   *
+   * @return handle to the value, INVALID_HANDLE when every slot is taken
+   */
+  int insert(T value) {
+    int index;
+    if (!freeSlots.empty()) {
+      index = freeSlots.front();
+      freeSlots.pop_front();
+    } else if (slots.size() <= HANDLE_INDEX_MASK) {
+      index = slots.size();
+      slots.emplace_back();
+    } else {
+      return INVALID_HANDLE;
+    }
+
+    Slot &slot = slots[index];
+    int handle = (slot.generation << HANDLE_INDEX_BITS) | index;
+    slot.valueIndex = values.size();
+    values.push_back(std::move(value));
+    valueHandles.push_back(handle);
+    return handle;
+  }
+
+  /**
+   * @return the value of the handle, or nullptr if it was erased
+   */
+  T *get(int handle) {
+    if (handle < 0 || handleIndex(handle) >= static_cast<int>(slots.size())) {
+      return nullptr;
+    }
+    Slot &slot = slots[handleIndex(handle)];
+    if (slot.valueIndex == -1 || slot.generation != handleGeneration(handle)) {
+      return nullptr;
+    }
+    return &values[slot.valueIndex];
+  }
+
+  /**
+   * Erase the value of the handle
+   *
+   * @return True if the handle had a value, False otherwise
+   */
+  bool erase(int handle) {
+    if (!get(handle)) {
+      return false;
+    }
+
+    Slot &slot = slots[handleIndex(handle)];
+    int valueIndex = slot.valueIndex;
+    int lastIndex = values.size() - 1;
+    if (valueIndex != lastIndex) {
+      values[valueIndex] = std::move(values[lastIndex]);
+      valueHandles[valueIndex] = valueHandles[lastIndex];
+      slots[handleIndex(valueHandles[valueIndex])].valueIndex = valueIndex;
+    }
+    values.pop_back();
+    valueHandles.pop_back();
+
+    slot.valueIndex = -1;
+    slot.generation = (slot.generation + 1) & HANDLE_GENERATION_MASK;
+    freeSlots.push_back(handleIndex(handle));
+    return true;
+  }
+
+  size_t size() const { return values.size(); }
+
+  typename std::vector<T>::iterator begin() { return values.begin(); }
+  typename std::vector<T>::iterator end() { return values.end(); }
+};
+
+#endif // !SLOT_MAP_H
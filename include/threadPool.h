@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads that run batches of indexed tasks.
+ *
+ * The calling thread takes part in every batch, so a pool of one thread runs
+ * everything inline.
+ */
+class ThreadPool {
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable batchStarted;
+  std::condition_variable batchFinished;
+
+  const std::function<void(size_t)> *task = nullptr;
+  size_t taskCount = 0;
+  std::atomic<size_t> nextTask;
+  int busyWorkers = 0;
+  unsigned long generation = 0;
+  bool stopping = false;
+
+  void workerLoop();
+  void runTasks();
+
+public:
+  /**
+   * @param threadCount number of threads running tasks, including the caller
+   */
+  ThreadPool(int threadCount);
+  ~ThreadPool();
+
+  int getThreadCount();
+
+  /**
+   * Run task(i) for every i in [0, taskCount) and return once all are done.
+   * Tasks are handed out in index order, but may run on any thread.
+   */
+  void parallelFor(size_t taskCount, const std::function<void(size_t)> &task);
+};
+
+#endif // !THREAD_POOL_H
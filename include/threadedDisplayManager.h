@@ -0,0 +1,161 @@
+#ifndef THREADED_DISPLAY_MANAGER_H
+#define THREADED_DISPLAY_MANAGER_H
+
+#include "XManager.h"
+#include "XShmManager.h"
+#include "gameObjects.h"
+#include "physics.h"
+#include "tripleBuffer.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * What the display needs of a game object to draw it
+ */
+struct RenderObject {
+  int id = -1;
+  physics::Position2D position{0, 0};
+  physics::Position2D previousPosition{0, 0};
+  double width = 0, height = 0;
+  bool visible = true;
+};
+
+/**
+ * Everything drawn on a frame, copied out of the game objects after a tick
+ */
+struct RenderScene {
+  bool hasPlayer = false;
+  RenderObject player;
+  std::vector<RenderObject> objects;
+  double interpolationAlpha = 1;
+};
+
+/**
+ * Copies game objects into render objects
+ */
+struct SceneVisitor : VisitorDisplay {
+  RenderObject object;
+
+  void visitRectangle(const Rectangle &rectangle) override;
+};
+
+/**
+ * Display manager drawing on a thread of its own.
+ *
+ * On the thread calling it, it only keeps track of the displayables, and
+ * after each tick publishes a RenderScene of them into a triple buffer. The
+ * render thread owns the X connection: it handles X events, takes the latest
+ * scene and draws it with a display manager of the given type. So physics
+ * never waits for the X server, and the display skips scenes when it falls
+ * behind.
+ *
+ * Key presses and window resizes are passed back to the calling thread, and
+ * show up on its next handleEvents.
+ */
+class ThreadedDisplayManager : public DisplayManager {
+  // Calling thread side
+  std::unique_ptr<Displayable> player;
+  std::vector<std::unique_ptr<Displayable>> displayables;
+  // Index of each displayable in displayables
+  std::unordered_map<DisplayVisitable *, size_t> displayableIndexes;
+  SceneVisitor sceneVisitor;
+  double interpolationAlpha = 1;
+
+  std::vector<Key> keysPressed;
+  int windowWidth, windowHeight, borderWidth;
+
+  std::vector<std::shared_ptr<Observer>> observers;
+
+  TripleBuffer<RenderScene> scenes;
+
+  // Render thread side
+  DisplayManagerType displayManagerType;
+  std::thread renderThread;
+  std::atomic<bool> stopFlag = false;
+  // Written to wake the render thread up, when a scene is published or a
+  // setting changed
+  int wakeFD;
+
+  // Shared by both threads, guarded by eventMutex
+  std::mutex eventMutex;
+  std::vector<Key> renderKeysPressed;
+  bool windowResized = false;
+  int renderWindowWidth, renderWindowHeight;
+  RenderStats renderStats;
+  // Settings not applied by the render thread yet, -1 when unchanged
+  int requestedRenderMode = -1;
+  int requestedWindowWidth = -1, requestedWindowHeight = -1;
+  int requestedBorderWidth = -1;
+
+  // Readable while events passed back were not handled yet
+  int inputFD;
+  std::atomic<bool> inputPending = false;
+
+  void setVisibility(std::shared_ptr<DisplayVisitable> &displayable,
+                     bool visibility);
+  /**
+   * Copy the displayables into the write buffer and publish it
+   */
+  void publishScene();
+
+  void wakeRenderThread();
+  void renderLoop(int windowWidth, int windowHeight, int borderWidth);
+
+public:
+  ThreadedDisplayManager(DisplayManagerType displayManagerType,
+                         int windowWidth, int windowHeight, int borderWidth);
+  ~ThreadedDisplayManager();
+
+  ThreadedDisplayManager(const ThreadedDisplayManager &) = delete;
+  ThreadedDisplayManager &operator=(const ThreadedDisplayManager &) = delete;
+
+  void addObserver(std::shared_ptr<Observer> observer) override;
+  void removeObserver(std::shared_ptr<Observer> &observer) override;
+  void notifyAll() override;
+
+  /**
+   * Publish the scene, drawn later by the render thread
+   */
+  void onNotified() override;
+
+  void addDisplayable(std::shared_ptr<DisplayVisitable> object) override;
+  void setPlayer(std::shared_ptr<DisplayVisitable> player) override;
+  bool
+  removeDisplayable(std::shared_ptr<DisplayVisitable> &displayable) override;
+  void removePlayer() override;
+  void setInvisible(std::shared_ptr<DisplayVisitable> &displayable) override;
+  void setVisible(std::shared_ptr<DisplayVisitable> &displayable) override;
+
+  // The render thread clears and draws every frame. Drawing publishes the
+  // scene, erasing does nothing
+  void draw() override;
+  void erase() override;
+  void visitRectangle(const Rectangle &rectangle) override {}
+
+  void setInterpolationAlpha(double alpha) override;
+
+  void setRenderMode(RenderMode mode) override;
+  /**
+   * @return what the last frame drawn by the render thread repainted
+   */
+  RenderStats getRenderStats() override;
+
+  void handleEvents() override;
+  int getEventFD() override;
+  bool hasPendingEvents() override;
+
+  const std::vector<Key> &getKeyPresses() override;
+  void clearKeyPresses() override;
+
+  void setWindowSize(int width, int height) override;
+  void setBorderWidth(int width) override;
+  int getWindowWidth() override;
+  int getWindowHeight() override;
+  int getBorderWidth() override;
+};
+
+#endif // !THREADED_DISPLAY_MANAGER_H
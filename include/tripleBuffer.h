@@ -0,0 +1,65 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Set in the shared index while it names a buffer the reader has not taken
+#define TRIPLE_BUFFER_FRESH 4
+#define TRIPLE_BUFFER_INDEX_MASK 3
+
+/**
+ * Hands values from one writer thread to one reader thread without locks.
+ *
+ * The writer fills a buffer of its own and publishes it, the reader takes the
+ * latest published buffer. Neither ever waits for the other: values published
+ * while the reader is busy replace each other, and only the latest is read.
+ * Buffers are reused, so values holding containers stop allocating once they
+ * have grown to size.
+ */
+template <typename T> class TripleBuffer {
+  T buffers[3];
+  // Buffer being written and buffer being read, each owned by one thread
+  uint8_t writing = 0;
+  uint8_t reading = 1;
+  // Buffer passed between the two, with TRIPLE_BUFFER_FRESH when published
+  std::atomic<uint8_t> shared{2};
+
+public:
+  /**
+   * @return the buffer to write the next value into, on the writer thread
+   */
+  T &getWriteBuffer() { return buffers[writing]; }
+
+  /**
+   * Make the write buffer the latest value, on the writer thread. The write
+   * buffer then holds an older value, to be overwritten
+   */
+  void publish() {
+    writing = shared.exchange(writing | TRIPLE_BUFFER_FRESH,
+                              std::memory_order_acq_rel) &
+              TRIPLE_BUFFER_INDEX_MASK;
+  }
+
+  /**
+   * Take the latest value, on the reader thread
+   *
+   * @return False if nothing was published since the last update, the read
+   * buffer is unchanged then
+   */
+  bool update() {
+    if (!(shared.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH)) {
+      return false;
+    }
+    reading = shared.exchange(reading, std::memory_order_acq_rel) &
+              TRIPLE_BUFFER_INDEX_MASK;
+    return true;
+  }
+
+  /**
+   * @return the value taken by the last update, on the reader thread
+   */
+  const T &getReadBuffer() const { return buffers[reading]; }
+};
+
+#endif // !TRIPLE_BUFFER_H
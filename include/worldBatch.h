@@ -0,0 +1,93 @@
+#ifndef WORLD_BATCH_H
+#define WORLD_BATCH_H
+
+#include "bodyStorage.h"
+#include "collisionEngine.h"
+#include "gameObjects.h"
+#include "physicsEngine.h"
+#include "threadPool.h"
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+/**
+ * Settings shared by every world of a batch
+ */
+struct WorldConfig {
+  double gravityPull;
+  double jumpImpulse;
+  double walkingSpeed;
+  int worldWidth;
+  int worldHeight;
+  // Milliseconds simulated by each step
+  int frameTimeDuration;
+  bool collisions;
+  CollisionEngineType collisionEngineType;
+  PhysicsStorageMode storageMode = OBJECT_STORAGE;
+};
+
+/**
+ * Independent physics worlds stepped in lockstep, without a display.
+ *
+ * Each world is stepped by a single thread, and the worlds are spread across
+ * the threads of the pool. After every step the state of the game objects
+ * added through the batch is gathered into contiguous arrays, world after
+ * world in the order the objects were added.
+ */
+class WorldBatch {
+  const WorldConfig config;
+  std::shared_ptr<ThreadPool> threadPool;
+
+  std::vector<std::unique_ptr<PhysicsEngine>> worlds;
+  // Game objects of each world, in the order they were added
+  std::vector<std::vector<std::shared_ptr<GameObject>>> worldObjects;
+
+  // Index in the state arrays of the first object of each world, followed by
+  // the total object count
+  std::vector<size_t> objectOffsets;
+  bool offsetsChanged = true;
+
+  CacheLineVector<double> positionX, positionY;
+  CacheLineVector<double> speedX, speedY;
+
+  void updateOffsets();
+  void gatherWorld(int world);
+
+public:
+  /**
+   * @param threadPool threads the worlds are stepped on, may be null to step
+   * them all on the calling thread
+   */
+  WorldBatch(const WorldConfig &config, int worldCount,
+             std::shared_ptr<ThreadPool> threadPool);
+
+  int getWorldCount();
+  /**
+   * Engine of one world, to set its player or send it commands between steps
+   */
+  PhysicsEngine &getWorld(int world);
+
+  void addGameObject(int world, std::shared_ptr<GameObject> gameObject);
+  /**
+   * @return True if the object was in the world, False otherwise
+   */
+  bool removeGameObject(int world, std::shared_ptr<GameObject> &gameObject);
+
+  /**
+   * Step every world steps times by the frame time of the configuration, then
+   * gather their state
+   */
+  void step(int steps = 1);
+
+  // Index of the first object of each world in the state arrays, followed by
+  // the total object count
+  std::span<const size_t> getObjectOffsets();
+
+  std::span<const double> getPositionX();
+  std::span<const double> getPositionY();
+  std::span<const double> getSpeedX();
+  std::span<const double> getSpeedY();
+};
+
+#endif // !WORLD_BATCH_H
@@ -0,0 +1,116 @@
+#ifndef WORLD_SNAPSHOT_H
+#define WORLD_SNAPSHOT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Physics state of one game object that stepping changes
+ */
+struct ObjectSnapshot {
+  int id;
+  double positionX, positionY;
+  double speedX, speedY;
+  double accelerationX, accelerationY;
+  double lastPositionX, lastPositionY;
+  double previousPositionX, previousPositionY;
+  int sleepFrames;
+  int island;
+  bool sleeping;
+};
+
+/**
+ * Cached contact between two game objects, named by ID
+ */
+struct ContactSnapshot {
+  int id1, id2;
+  double normalX, normalY;
+  double normalImpulse;
+  bool touched;
+};
+
+static_assert(std::is_trivially_copyable_v<ObjectSnapshot>);
+static_assert(std::is_trivially_copyable_v<ContactSnapshot>);
+
+/**
+ * State of a whole physics world between two steps. Objects and contacts are
+ * flat blocks of plain data, so once the blocks have grown to the size of the
+ * world, saving and restoring copy memory without allocating.
+ *
+ * Commands queued but not applied yet are input, not state, and are left out.
+ */
+struct WorldSnapshot {
+  bool hasPlayer = false;
+  ObjectSnapshot player;
+  bool playerWalkingLeft;
+  bool playerWalkingRight;
+
+  int nextIslandID;
+  std::chrono::nanoseconds accumulator;
+  double interpolationAlpha;
+
+  std::vector<ObjectSnapshot> objects;
+  std::vector<ContactSnapshot> contacts;
+};
+
+/**
+ * Ring of the latest snapshots of a world, allocated up front. Pushing past
+ * the capacity overwrites the oldest snapshot
+ */
+class SnapshotRing {
+  std::vector<WorldSnapshot> snapshots;
+  // Slot of the newest snapshot
+  size_t newest = 0;
+  size_t count = 0;
+
+public:
+  /**
+   * @param objectCapacity objects each snapshot holds without allocating
+   * @param contactCapacity contacts each snapshot holds without allocating
+   */
+  SnapshotRing(size_t capacity, size_t objectCapacity, size_t contactCapacity)
+      : snapshots(capacity), newest(capacity - 1) {
+    for (auto iter = snapshots.begin(); iter != snapshots.end(); iter++) {
+      iter->objects.reserve(objectCapacity);
+      iter->contacts.reserve(contactCapacity);
+    }
+  }
+
+  /**
+   * @return the snapshot to save the world into
+   */
+  WorldSnapshot &push() {
+    newest = (newest + 1) % snapshots.size();
+    count = std::min(count + 1, snapshots.size());
+    return snapshots[newest];
+  }
+
+  /**
+   * @param age 0 for the newest snapshot, 1 for the one before it, and so on
+   * @return the snapshot, or nullptr if it is not kept
+   */
+  WorldSnapshot *get(size_t age) {
+    if (age >= count) {
+      return nullptr;
+    }
+    return &snapshots[(newest + snapshots.size() - age) % snapshots.size()];
+  }
+
+  /**
+   * Drop the age newest snapshots, so the one age steps back becomes the
+   * newest. Used after rolling the world back to it
+   */
+  void rewind(size_t age) {
+    age = std::min(age, count);
+    newest = (newest + snapshots.size() - age) % snapshots.size();
+    count -= age;
+  }
+
+  size_t size() const { return count; }
+  size_t capacity() const { return snapshots.size(); }
+};
+
+#endif // !WORLD_SNAPSHOT_H
@@ -1,6 +1,7 @@
 #include "XManager.h"
 #include "designPatterns.h"
 #include <X11/keysym.h>
+#include <algorithm>
 #include <cstdlib>
 #include <memory>
 
@@ -16,9 +17,48 @@ XManager::XManager(int windowWidth, int windowHeight, int borderWidth)
 
 XManager::~XManager() { destroyWindow(); }
 
+static ScreenBounds rectangleBounds(const Rectangle &rectangle,
+                                    double interpolationAlpha) {
+  const physics::Position2D &previous = rectangle.previousPosition;
+  double x =
+      previous.x + (rectangle.position.x - previous.x) * interpolationAlpha;
+  double y =
+      previous.y + (rectangle.position.y - previous.y) * interpolationAlpha;
+  return {(int)x, (int)y, (int)rectangle.width, (int)rectangle.height};
+}
+
+void BoundsVisitor::visitRectangle(const Rectangle &rectangle) {
+  bounds = rectangleBounds(rectangle, interpolationAlpha);
+}
+
 void XManager::visitRectangle(const Rectangle &rectangle) {
-  XFillRectangle(display, window, gc, (int)rectangle.position.x,
-                 (int)rectangle.position.y, rectangle.width, rectangle.height);
+  ScreenBounds bounds = rectangleBounds(rectangle, interpolationAlpha);
+  pendingRectangles.push_back({(short)bounds.x, (short)bounds.y,
+                               (unsigned short)bounds.width,
+                               (unsigned short)bounds.height});
+}
+
+void XManager::flushRectangles() {
+  fillRectangles(pendingRectangles.data(), pendingRectangles.size(),
+                 WhitePixel(display, screenNum));
+  pendingRectangles.clear();
+}
+
+void XManager::fillRectangles(const XRectangle *rectangles, size_t count,
+                              unsigned long pixel) {
+  // A PolyFillRectangle request is 3 units of 4 bytes, plus 2 per rectangle.
+  // Past the core limit, BIG-REQUESTS adds a unit for the extended length
+  long maxRequestSize = XExtendedMaxRequestSize(display);
+  size_t chunkSize = maxRequestSize != 0
+                         ? (maxRequestSize - 4) / 2
+                         : (XMaxRequestSize(display) - 3) / 2;
+
+  XSetForeground(display, gc, pixel);
+  for (size_t begin = 0; begin < count; begin += chunkSize) {
+    XFillRectangles(display, backBuffer, gc,
+                    const_cast<XRectangle *>(rectangles + begin),
+                    std::min(chunkSize, count - begin));
+  }
 }
 
 void XManager::updateWindowSize() {
@@ -26,9 +66,23 @@ void XManager::updateWindowSize() {
   XGetWindowAttributes(display, window, &attributes);
   windowWidth = attributes.width;
   windowHeight = attributes.height;
+
+  // Reallocated on the next frame
+  if (!backBufferFits()) {
+    releaseBackBuffer();
+  }
+  fullRedraw = true;
+}
+
+void XManager::releaseBackBuffer() {
+  if (backBufferCreated) {
+    destroyBackBuffer();
+    backBufferCreated = false;
+  }
 }
 
 void XManager::destroyWindow() {
+  releaseBackBuffer();
   XFreeGC(display, gc);
   XDestroyWindow(display, window);
   XCloseDisplay(display);
@@ -47,10 +101,116 @@ void XManager::createWindow() {
                                BlackPixel(display, screenNum));
 
   XSelectInput(display, window,
-               KeyPressMask | KeyReleaseMask | StructureNotifyMask);
+               KeyPressMask | KeyReleaseMask | StructureNotifyMask |
+                   ExposureMask);
   XMapWindow(display, window);
 
   gc = XCreateGC(display, window, 0, nullptr);
+
+  int majorVersion, minorVersion;
+  doubleBufferExtension =
+      XdbeQueryExtension(display, &majorVersion, &minorVersion);
+}
+
+void XManager::createBackBuffer() {
+  backBufferWidth = windowWidth;
+  backBufferHeight = windowHeight;
+  if (doubleBufferExtension) {
+    // Every pixel is painted each frame, so what a swap leaves behind does
+    // not matter
+    backBuffer = XdbeAllocateBackBufferName(display, window, XdbeUndefined);
+  } else {
+    backBuffer = XCreatePixmap(display, window, windowWidth, windowHeight,
+                               DefaultDepth(display, screenNum));
+  }
+}
+
+void XManager::destroyBackBuffer() {
+  if (doubleBufferExtension) {
+    XdbeDeallocateBackBufferName(display, backBuffer);
+  } else {
+    XFreePixmap(display, backBuffer);
+  }
+}
+
+bool XManager::backBufferFits() {
+  // DBE buffers follow the window size, pixmaps have to be reallocated
+  return doubleBufferExtension || (windowWidth == backBufferWidth &&
+                                   windowHeight == backBufferHeight);
+}
+
+void XManager::presentBackBuffer() {
+  if (doubleBufferExtension) {
+    // Damage tracking draws over the last frame, so the swap has to leave it
+    // in the back buffer
+    XdbeSwapInfo swapInfo;
+    swapInfo.swap_window = window;
+    swapInfo.swap_action =
+        renderMode == DAMAGE_TRACKING ? XdbeCopied : XdbeUndefined;
+    XdbeSwapBuffers(display, &swapInfo, 1);
+  } else if (renderMode == DAMAGE_TRACKING && !damage.empty()) {
+    const std::vector<ScreenBounds> &rectangles = damage.getRectangles();
+    for (auto iter = rectangles.begin(); iter != rectangles.end(); iter++) {
+      XCopyArea(display, backBuffer, window, gc, iter->x, iter->y, iter->width,
+                iter->height, iter->x, iter->y);
+    }
+  } else {
+    XCopyArea(display, backBuffer, window, gc, 0, 0, windowWidth, windowHeight,
+              0, 0);
+  }
+}
+
+void XManager::trackDamage(Displayable &displayable) {
+  ScreenBounds bounds;
+  if (displayable.display) {
+    displayable.displayable->accept(boundsVisitor);
+    bounds = boundsVisitor.bounds;
+  }
+
+  if (bounds != displayable.drawnBounds) {
+    damage.add(displayable.drawnBounds);
+    damage.add(bounds);
+    displayable.drawnBounds = bounds;
+  }
+}
+
+void XManager::drawDamage() {
+  damage.clip({0, 0, windowWidth, windowHeight});
+  renderStats = RenderStats();
+  if (damage.empty()) {
+    return;
+  }
+
+  const std::vector<ScreenBounds> &rectangles = damage.getRectangles();
+  clearedRectangles.clear();
+  for (auto iter = rectangles.begin(); iter != rectangles.end(); iter++) {
+    clearedRectangles.push_back({(short)iter->x, (short)iter->y,
+                                 (unsigned short)iter->width,
+                                 (unsigned short)iter->height});
+  }
+  fillRectangles(clearedRectangles.data(), clearedRectangles.size(),
+                 BlackPixel(display, screenNum));
+
+  // Clearing cut into the displayables overlapping the damage, so they are
+  // repainted whole
+  if (player && player->display && damage.intersects(player->drawnBounds)) {
+    player->displayable->accept(*this);
+    renderStats.objectsDrawn++;
+  }
+  for (auto iter = displayables.begin(); iter != displayables.end(); iter++) {
+    if ((*iter)->display && damage.intersects((*iter)->drawnBounds)) {
+      (*iter)->displayable->accept(*this);
+      renderStats.objectsDrawn++;
+    }
+  }
+  flushRectangles();
+
+  presentBackBuffer();
+
+  renderStats.dirtyRectangles = rectangles.size();
+  renderStats.dirtyAreaPercentage =
+      100.0 * damage.area() / ((long)windowWidth * windowHeight);
+  damage.clear();
 }
 
 Key XManager::convertXKtoKey(int xk_key) {
@@ -102,53 +262,95 @@ void XManager::notifyAll() {
 }
 
 void XManager::onNotified() {
+  // Created here rather than with the window, so that derived classes get
+  // their own back buffer
+  if (!backBufferCreated) {
+    createBackBuffer();
+    backBufferCreated = true;
+    fullRedraw = true;
+  }
+
+  if (renderMode == DAMAGE_TRACKING) {
+    boundsVisitor.interpolationAlpha = interpolationAlpha;
+    if (player) {
+      trackDamage(*player);
+    }
+    for (auto iter = displayables.begin(); iter != displayables.end(); iter++) {
+      trackDamage(**iter);
+    }
+
+    if (!fullRedraw) {
+      drawDamage();
+      return;
+    }
+  }
+
   erase();
   draw();
+  damage.clear();
+  presentBackBuffer();
+  fullRedraw = false;
+
+  renderStats.dirtyRectangles = 1;
+  renderStats.dirtyAreaPercentage = 100;
+  renderStats.objectsDrawn = player && player->display ? 1 : 0;
+  for (auto iter = displayables.begin(); iter != displayables.end(); iter++) {
+    renderStats.objectsDrawn += (*iter)->display;
+  }
 }
 
 void XManager::addDisplayable(std::shared_ptr<DisplayVisitable> object) {
+  displayableIndexes[object.get()] = displayables.size();
   displayables.push_back(std::make_unique<Displayable>(object));
 }
 
 void XManager::setPlayer(std::shared_ptr<DisplayVisitable> player) {
+  if (this->player) {
+    damage.add(this->player->drawnBounds);
+  }
   this->player = std::make_unique<Displayable>(player);
 }
 
 bool XManager::removeDisplayable(
     std::shared_ptr<DisplayVisitable> &displayable) {
-  auto result = std::find_if(displayables.begin(), displayables.end(),
-                             [displayable](std::unique_ptr<Displayable> &d) {
-                               return d->displayable == displayable;
-                             });
-
-  if (result == displayables.end()) {
+  auto result = displayableIndexes.find(displayable.get());
+  if (result == displayableIndexes.end()) {
     return false;
   }
 
-  displayables.erase(result);
+  // Swap the last displayable into the freed place
+  size_t index = result->second;
+  displayableIndexes.erase(result);
+  damage.add(displayables[index]->drawnBounds);
+  if (index != displayables.size() - 1) {
+    displayables[index] = std::move(displayables.back());
+    displayableIndexes[displayables[index]->displayable.get()] = index;
+  }
+  displayables.pop_back();
   return true;
 }
 
-void XManager::removePlayer() { player = NULL; }
+void XManager::removePlayer() {
+  if (player) {
+    damage.add(player->drawnBounds);
+  }
+  player = NULL;
+}
 
 void XManager::setVisibility(std::shared_ptr<DisplayVisitable> &displayable,
                              bool visibile) {
 
-  if (displayable == player->displayable) {
+  if (player && displayable == player->displayable) {
     player->display = visibile;
     return;
   }
 
-  auto result = std::find_if(displayables.begin(), displayables.end(),
-                             [displayable](std::unique_ptr<Displayable> &d) {
-                               return d->displayable == displayable;
-                             });
-
-  if (result == displayables.end()) {
+  auto result = displayableIndexes.find(displayable.get());
+  if (result == displayableIndexes.end()) {
     return;
   }
 
-  (*result)->display = visibile;
+  displayables[result->second]->display = visibile;
 }
 
 void XManager::setInvisible(std::shared_ptr<DisplayVisitable> &displayable) {
@@ -160,16 +362,35 @@ void XManager::setVisible(std::shared_ptr<DisplayVisitable> &displayable) {
 }
 
 void XManager::draw() {
-  player->displayable->accept(*this);
+  if (player && player->display) {
+    player->displayable->accept(*this);
+  }
   for (auto iter = displayables.begin(); iter != displayables.end(); iter++) {
-    (*iter)->displayable->accept(*this);
+    if ((*iter)->display) {
+      (*iter)->displayable->accept(*this);
+    }
+  }
+  flushRectangles();
+}
+
+void XManager::setInterpolationAlpha(double alpha) {
+  interpolationAlpha = alpha;
+}
+
+void XManager::setRenderMode(RenderMode mode) {
+  if (renderMode == mode) {
+    return;
   }
+  renderMode = mode;
+  fullRedraw = true;
 }
 
+RenderStats XManager::getRenderStats() { return renderStats; }
+
 void XManager::erase() {
-  XSetForeground(display, gc, BlackPixel(display, screenNum));
-  XFillRectangle(display, window, gc, 0, 0, windowWidth, windowHeight);
-  XSetForeground(display, gc, WhitePixel(display, screenNum));
+  XRectangle bounds = {0, 0, (unsigned short)windowWidth,
+                       (unsigned short)windowHeight};
+  fillRectangles(&bounds, 1, BlackPixel(display, screenNum));
 }
 
 void XManager::handleEvents() {
@@ -197,12 +418,23 @@ void XManager::handleEvents() {
       break;
     }
 
+    case Expose: {
+      // The window lost what was drawn on it
+      fullRedraw = true;
+      break;
+    }
+
     default:
+      handleOtherEvent(event);
       break;
     }
   }
 }
 
+int XManager::getEventFD() { return ConnectionNumber(display); }
+
+bool XManager::hasPendingEvents() { return XPending(display) > 0; }
+
 const std::vector<Key> &XManager::getKeyPresses() { return keysPressed; }
 
 void XManager::clearKeyPresses() { keysPressed.clear(); }
@@ -0,0 +1,239 @@
+#include "XShmManager.h"
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+// Set by onAttachError, as X errors are reported to a handler without context
+static bool attachFailed = false;
+
+static int onAttachError(Display *display, XErrorEvent *error) {
+  attachFailed = true;
+  return 0;
+}
+
+static Bool isCompletionEvent(Display *display, XEvent *event, XPointer type) {
+  return event->type == *(int *)type;
+}
+
+/**
+ * Write count pixels from row, a batch of pixels per store
+ */
+static void fillSpan(uint32_t *row, int count, const PixelBatch &batch,
+                     uint32_t pixel) {
+  int i = 0;
+  for (; i + PIXEL_BATCH_SIZE <= count; i += PIXEL_BATCH_SIZE) {
+    // Rows are only 4 byte aligned
+    std::memcpy(row + i, &batch, sizeof(batch));
+  }
+  for (; i < count; i++) {
+    row[i] = pixel;
+  }
+}
+
+/**
+ * Cut the rectangle down to the image
+ *
+ * @return False if no pixel of the rectangle is in the image
+ */
+static bool clipRectangle(const XRectangle &rectangle, const XImage *image,
+                          int &minX, int &minY, int &maxX, int &maxY) {
+  minX = std::max((int)rectangle.x, 0);
+  minY = std::max((int)rectangle.y, 0);
+  maxX = std::min(rectangle.x + (int)rectangle.width, image->width);
+  maxY = std::min(rectangle.y + (int)rectangle.height, image->height);
+  return minX < maxX && minY < maxY;
+}
+
+XShmManager::XShmManager(int windowWidth, int windowHeight, int borderWidth)
+    : XManager(windowWidth, windowHeight, borderWidth) {}
+
+XShmManager::~XShmManager() { releaseBackBuffer(); }
+
+bool XShmManager::isSharedMemory() { return sharedMemory; }
+
+bool XShmManager::createSharedImage(Visual *visual, int depth, int width,
+                                    int height) {
+  if (!XShmQueryExtension(display)) {
+    return false;
+  }
+  completionEventType = XShmGetEventBase(display) + ShmCompletion;
+
+  image = XShmCreateImage(display, visual, depth, ZPixmap, nullptr, &shmInfo,
+                          width, height);
+  if (image == nullptr) {
+    return false;
+  }
+  shmInfo.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * image->height,
+                         IPC_CREAT | 0600);
+  if (shmInfo.shmid == -1) {
+    XDestroyImage(image);
+    return false;
+  }
+  shmInfo.shmaddr = (char *)shmat(shmInfo.shmid, nullptr, 0);
+  if (shmInfo.shmaddr == (char *)-1) {
+    shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+    XDestroyImage(image);
+    return false;
+  }
+  image->data = shmInfo.shmaddr;
+  shmInfo.readOnly = False;
+
+  // Attaching fails on servers that cannot reach this client's memory, and
+  // the error only arrives once the request was processed
+  attachFailed = false;
+  XErrorHandler previousHandler = XSetErrorHandler(onAttachError);
+  bool attached = XShmAttach(display, &shmInfo);
+  XSync(display, False);
+  XSetErrorHandler(previousHandler);
+
+  // The segment is freed once both sides detach from it
+  shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+
+  if (!attached || attachFailed) {
+    shmdt(shmInfo.shmaddr);
+    image->data = nullptr;
+    XDestroyImage(image);
+    return false;
+  }
+  return true;
+}
+
+void XShmManager::createBackBuffer() {
+  backBufferWidth = windowWidth;
+  backBufferHeight = windowHeight;
+
+  Visual *visual = DefaultVisual(display, screenNum);
+  int depth = DefaultDepth(display, screenNum);
+  int width = std::max(windowWidth, 1);
+  int height = std::max(windowHeight, 1);
+
+  sharedMemory = createSharedImage(visual, depth, width, height);
+  if (sharedMemory) {
+    return;
+  }
+
+  image = XCreateImage(display, visual, depth, ZPixmap, 0, nullptr, width,
+                       height, 32, 0);
+  if (image == nullptr) {
+    exit(EXIT_FAILURE);
+  }
+  image->data = (char *)malloc(image->bytes_per_line * image->height);
+  if (image->data == nullptr) {
+    exit(EXIT_FAILURE);
+  }
+}
+
+void XShmManager::destroyBackBuffer() {
+  if (sharedMemory) {
+    waitForCompletion();
+    XShmDetach(display, &shmInfo);
+    XSync(display, False);
+    shmdt(shmInfo.shmaddr);
+    image->data = nullptr;
+  }
+  XDestroyImage(image);
+  image = nullptr;
+}
+
+bool XShmManager::backBufferFits() {
+  return windowWidth == backBufferWidth && windowHeight == backBufferHeight;
+}
+
+void XShmManager::presentBackBuffer() {
+  std::vector<ScreenBounds> fullWindow = {{0, 0, image->width, image->height}};
+  const std::vector<ScreenBounds> &rectangles =
+      renderMode == DAMAGE_TRACKING && !damage.empty() ? damage.getRectangles()
+                                                       : fullWindow;
+
+  for (auto iter = rectangles.begin(); iter != rectangles.end(); iter++) {
+    if (!sharedMemory) {
+      XPutImage(display, window, gc, image, iter->x, iter->y, iter->x, iter->y,
+                iter->width, iter->height);
+      continue;
+    }
+    // Requests are processed in order, so the completion of the last one
+    // tells the whole image was read
+    bool last = iter + 1 == rectangles.end();
+    XShmPutImage(display, window, gc, image, iter->x, iter->y, iter->x,
+                 iter->y, iter->width, iter->height, last);
+    if (last) {
+      pendingCompletions++;
+    }
+  }
+  XFlush(display);
+}
+
+void XShmManager::waitForCompletion() {
+  XEvent event;
+  while (pendingCompletions > 0) {
+    XIfEvent(display, &event, isCompletionEvent,
+             (XPointer)&completionEventType);
+    pendingCompletions--;
+  }
+}
+
+void XShmManager::handleOtherEvent(const XEvent &event) {
+  if (sharedMemory && event.type == completionEventType &&
+      pendingCompletions > 0) {
+    pendingCompletions--;
+  }
+}
+
+void XShmManager::fillRectangles(const XRectangle *rectangles, size_t count,
+                                 unsigned long pixel) {
+  if (count == 0) {
+    return;
+  }
+  waitForCompletion();
+
+  int nativeByteOrder =
+      std::endian::native == std::endian::little ? LSBFirst : MSBFirst;
+  if (image->bits_per_pixel != 32 || image->byte_order != nativeByteOrder) {
+    fillRectanglesSlow(rectangles, count, pixel);
+    return;
+  }
+
+  PixelBatch batch = PixelBatch{} + (uint32_t)pixel;
+  for (size_t i = 0; i < count; i++) {
+    int minX, minY, maxX, maxY;
+    if (!clipRectangle(rectangles[i], image, minX, minY, maxX, maxY)) {
+      continue;
+    }
+    char *row = image->data + (long)minY * image->bytes_per_line;
+    for (int y = minY; y < maxY; y++, row += image->bytes_per_line) {
+      fillSpan((uint32_t *)row + minX, maxX - minX, batch, pixel);
+    }
+  }
+}
+
+void XShmManager::fillRectanglesSlow(const XRectangle *rectangles,
+                                     size_t count, unsigned long pixel) {
+  for (size_t i = 0; i < count; i++) {
+    int minX, minY, maxX, maxY;
+    if (!clipRectangle(rectangles[i], image, minX, minY, maxX, maxY)) {
+      continue;
+    }
+    for (int y = minY; y < maxY; y++) {
+      for (int x = minX; x < maxX; x++) {
+        XPutPixel(image, x, y, pixel);
+      }
+    }
+  }
+}
+
+std::shared_ptr<DisplayManager>
+DisplayManagerFactory::createDisplayManager(DisplayManagerType type,
+                                            int windowWidth, int windowHeight,
+                                            int borderWidth) {
+  switch (type) {
+  case X_SHARED_MEMORY:
+    return std::make_shared<XShmManager>(windowWidth, windowHeight,
+                                         borderWidth);
+  case X_DRAWING:
+  default:
+    return std::make_shared<XManager>(windowWidth, windowHeight, borderWidth);
+  }
+}
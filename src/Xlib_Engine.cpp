@@ -1,22 +1,49 @@
 #include "Xlib_Engine.h"
 #include <algorithm>
 #include <memory>
+#include <thread>
 
 void WindowChangeObserver::onNotified() { gameEngine->updateWorldSize(); }
 
-void FrameObserver::onNotified() { gameEngine->notifyAll(); }
+void FrameObserver::onNotified() {
+  gameEngine->endFrame();
+  gameEngine->updateInterpolationAlpha();
+  gameEngine->notifyAll();
+}
 
 GameEngine::GameEngine(int windowWidth, int windowHeight, int borderWidth,
                        double gravitationalPull, double jumpImpulse,
                        double walkingSpeed, int frameDuration,
-                       bool collisions) {
-  auto collisionEngine = new MockCollisionEngine();
-  displayManager =
-      std::make_shared<XManager>(windowWidth, windowHeight, borderWidth);
+                       bool collisions)
+    : GameEngine(windowWidth, windowHeight, borderWidth, gravitationalPull,
+                 jumpImpulse, walkingSpeed, frameDuration, collisions,
+                 GameEngineOptions()) {}
+
+GameEngine::GameEngine(int windowWidth, int windowHeight, int borderWidth,
+                       double gravitationalPull, double jumpImpulse,
+                       double walkingSpeed, int frameDuration, bool collisions,
+                       const GameEngineOptions &options) {
+  CollisionEngine *collisionEngine =
+      collisionEngineFactory.createCollisionEngine(
+          options.collisionEngineType, windowWidth, windowHeight);
+  if (options.renderThread) {
+    displayManager = std::make_shared<ThreadedDisplayManager>(
+        options.displayManagerType, windowWidth, windowHeight, borderWidth);
+  } else {
+    displayManager = displayManagerFactory.createDisplayManager(
+        options.displayManagerType, windowWidth, windowHeight, borderWidth);
+  }
 
   physicsEngine = std::make_shared<XPhysicsEngine>(
       gravitationalPull, jumpImpulse, walkingSpeed, windowWidth, windowHeight,
       frameDuration, collisionEngine, collisions);
+  // A single thread runs without a pool, which finds collisions object by
+  // object as the engine always did
+  if (options.threadCount > 1) {
+    physicsEngine->setThreadPool(
+        std::make_shared<ThreadPool>(options.threadCount));
+  }
+  engineThread = std::this_thread::get_id();
 
   windowChangeObserver = std::make_shared<WindowChangeObserver>(this);
   frameObserver = std::make_shared<FrameObserver>(this);
@@ -32,6 +59,10 @@ void GameEngine::updateWorldSize() {
                               displayManager->getWindowHeight());
 }
 
+void GameEngine::updateInterpolationAlpha() {
+  displayManager->setInterpolationAlpha(physicsEngine->getInterpolationAlpha());
+}
+
 void GameEngine::handleKeyPresses() {
 
   const std::vector<Key> keysPressed = displayManager->getKeyPresses();
@@ -47,10 +78,16 @@ void GameEngine::handleKeyPresses() {
 std::shared_ptr<GameObject>
 GameEngine::createNewGameObject(GameObjectType type, int x, int y, int width,
                                 int height, int mass) {
+  int id = gameObjects.insert(nullptr);
+  if (id == INVALID_HANDLE) {
+    return nullptr;
+  }
   std::shared_ptr<GameObject> gameObject =
-      gameObjectFactory.createGameObject(type, gameObjectInstantiationCount++);
+      gameObjectFactory.createGameObject(type, id);
+  *gameObjects.get(id) = gameObject;
   gameObject->position.x = x;
   gameObject->position.y = y;
+  gameObject->previousPosition = gameObject->position;
 
   gameObject->width = width;
   gameObject->height = height;
@@ -66,23 +103,33 @@ GameEngine::createNewGameObject(GameObjectType type, int x, int y, int width,
 
 std::shared_ptr<GameObject> &GameEngine::getObjectByID(int objectID) {
   static std::shared_ptr<GameObject> nullPtr;
-  auto result = std::find_if(
-      gameObjects.begin(), gameObjects.end(),
-      [objectID](std::shared_ptr<GameObject> g) { return g->id == objectID; });
+  std::shared_ptr<GameObject> *result = gameObjects.get(objectID);
 
-  return result != gameObjects.end() ? *result : nullPtr;
+  return result ? *result : nullPtr;
 }
 
 void GameEngine::run() {
+  engineThread = std::this_thread::get_id();
   while (!exitFlag) {
     displayManager->handleEvents();
     handleKeyPresses();
     physicsEngine->tick();
+
+    if (!exitFlag && !displayManager->hasPendingEvents()) {
+      frameScheduler.waitFor(displayManager->getEventFD(),
+                             physicsEngine->getTimeUntilNextTick());
+    }
   }
 }
 
 void GameEngine::exit() { exitFlag = true; }
 
+void GameEngine::endFrame() { frameScheduler.endFrame(); }
+
+std::chrono::nanoseconds GameEngine::getFrameSleepTime() {
+  return frameScheduler.getFrameSleepTime();
+}
+
 void GameEngine::notifyAll() {
   for (auto iter = observers.begin(); iter != observers.end(); iter++) {
     (*iter)->onNotified();
@@ -100,6 +147,9 @@ void GameEngine::removeObserver(std::shared_ptr<Observer> &observer) {
 
 void GameEngine::setNewPlayer(GameObjectType type, int x, int y, int width,
                               int height, int mass) {
+  if (player) {
+    gameObjects.erase(player->id);
+  }
   player = createNewGameObject(type, x, y, width, height, mass);
 
   displayManager->setPlayer(player);
@@ -110,8 +160,10 @@ int GameEngine::addNewObject(GameObjectType type, int x, int y, int width,
                              int height, int mass) {
   std::shared_ptr<GameObject> gameObject =
       createNewGameObject(type, x, y, width, height, mass);
+  if (!gameObject) {
+    return INVALID_HANDLE;
+  }
 
-  gameObjects.push_back(gameObject);
   displayManager->addDisplayable(gameObject);
   physicsEngine->addGameObject(gameObject);
 
@@ -121,23 +173,23 @@ int GameEngine::addNewObject(GameObjectType type, int x, int y, int width,
 void GameEngine::removePlayer() {
   physicsEngine->removePlayer();
   displayManager->removePlayer();
+  if (player) {
+    gameObjects.erase(player->id);
+  }
   player = NULL;
 }
 
 bool GameEngine::removeGameObject(int objectID) {
-  auto gameObject = std::find_if(
-      gameObjects.begin(), gameObjects.end(),
-      [objectID](std::shared_ptr<GameObject> g) { return g->id == objectID; });
-
-  if (gameObject == gameObjects.end()) {
+  std::shared_ptr<GameObject> removed = getObjectByID(objectID);
+  // The player has its own slot, but is only removed by removePlayer
+  if (!removed || removed == player) {
     return false;
   }
+  std::shared_ptr<DisplayVisitable> displayVisitable = removed;
 
-  std::shared_ptr<DisplayVisitable> displayVisitable = *gameObject;
-
-  gameObjects.erase(gameObject);
   displayManager->removeDisplayable(displayVisitable);
-  physicsEngine->removeGameObject(*gameObject);
+  physicsEngine->removeGameObject(removed);
+  gameObjects.erase(objectID);
 
   return true;
 }
@@ -167,6 +219,12 @@ void GameEngine::playerSetSpeed(double x, double y) {
   physicsEngine->setPlayerSpeed(speed);
 }
 
+void GameEngine::playerSetCollisionFilter(uint32_t category, uint32_t mask) {
+  if (player) {
+    physicsEngine->setObjectCollisionFilter(player, category, mask);
+  }
+}
+
 void GameEngine::jumpObject(int objectID) {
   std::shared_ptr<GameObject> gameObject = getObjectByID(objectID);
   if (gameObject) {
@@ -212,6 +270,93 @@ void GameEngine::objectSetSpeed(int objectID, double x, double y) {
   }
 }
 
+void GameEngine::objectSetFast(int objectID, bool fast) {
+  std::shared_ptr<GameObject> gameObject = getObjectByID(objectID);
+  if (gameObject) {
+    physicsEngine->setObjectFast(gameObject, fast);
+  }
+}
+
+void GameEngine::objectSetRestitution(int objectID, double restitution) {
+  std::shared_ptr<GameObject> gameObject = getObjectByID(objectID);
+  if (gameObject) {
+    physicsEngine->setObjectRestitution(gameObject, restitution);
+  }
+}
+
+void GameEngine::objectSetCollisionFilter(int objectID, uint32_t category,
+                                          uint32_t mask) {
+  std::shared_ptr<GameObject> gameObject = getObjectByID(objectID);
+  if (gameObject) {
+    physicsEngine->setObjectCollisionFilter(gameObject, category, mask);
+  }
+}
+
+void GameEngine::objectsApplyForce(std::span<const int> objectIDs,
+                                   std::span<const double> x,
+                                   std::span<const double> y) {
+  sendCommands(COMMAND_APPLY_FORCE, objectIDs, x, y);
+}
+
+void GameEngine::objectsSetSpeed(std::span<const int> objectIDs,
+                                 std::span<const double> x,
+                                 std::span<const double> y) {
+  sendCommands(COMMAND_SET_SPEED, objectIDs, x, y);
+}
+
+void GameEngine::objectsSetAt(std::span<const int> objectIDs,
+                              std::span<const double> x,
+                              std::span<const double> y) {
+  sendCommands(COMMAND_SET_POSITION, objectIDs, x, y);
+}
+
+void GameEngine::sendCommands(ObjectCommandType type,
+                              std::span<const int> objectIDs,
+                              std::span<const double> x,
+                              std::span<const double> y) {
+  size_t count = std::min({objectIDs.size(), x.size(), y.size()});
+  std::vector<ObjectCommand> commands(count);
+  for (size_t i = 0; i < count; i++) {
+    commands[i] = {type, objectIDs[i], x[i], y[i]};
+  }
+
+  if (std::this_thread::get_id() == engineThread) {
+    physicsEngine->applyCommands(commands);
+  } else {
+    physicsEngine->queueCommands(commands);
+  }
+}
+
+void GameEngine::setSolverIterations(int iterations) {
+  physicsEngine->setSolverIterations(iterations);
+}
+
+void GameEngine::setPhysicsStorageMode(PhysicsStorageMode mode) {
+  physicsEngine->setStorageMode(mode);
+}
+
+void GameEngine::setFixedTimestep(int stepsPerSecond, int maxCatchUpSteps) {
+  physicsEngine->setFixedTimestep(stepsPerSecond, maxCatchUpSteps);
+}
+
+void GameEngine::setVariableTimestep() { physicsEngine->setVariableTimestep(); }
+
+void GameEngine::setRenderMode(RenderMode mode) {
+  displayManager->setRenderMode(mode);
+}
+
+RenderStats GameEngine::getRenderStats() {
+  return displayManager->getRenderStats();
+}
+
+void GameEngine::saveSnapshot(WorldSnapshot &snapshot) {
+  physicsEngine->saveSnapshot(snapshot);
+}
+
+bool GameEngine::restoreSnapshot(const WorldSnapshot &snapshot) {
+  return physicsEngine->restoreSnapshot(snapshot);
+}
+
 void GameEngine::playerSetWalkingSpeed(int speed) {
   physicsEngine->playerSetWalkingSpeed(speed);
 }
@@ -236,21 +381,21 @@ int GameEngine::addSprite(GameObjectType type, int x, int y, int width,
                           int height, int mass) {
   std::shared_ptr<GameObject> gameObject =
       createNewGameObject(type, x, y, width, height, mass);
+  // Sprites are decoration and never collide
+  if (!gameObject) {
+    return INVALID_HANDLE;
+  }
+  gameObject->collisionCategory = 0;
+  gameObject->collisionMask = 0;
 
-  gameObjects.push_back(gameObject);
   displayManager->addDisplayable(gameObject);
 
   return gameObject->id;
 }
 
 bool GameEngine::removeSprite(int objectID) {
-  std::shared_ptr<GameObject> gameObject = getObjectByID(objectID);
-  if (gameObject) {
-    std::shared_ptr<DisplayVisitable> displayVisitable = gameObject;
-    displayManager->removeDisplayable(displayVisitable);
-    return true;
-  }
-  return false;
+  // Sprites are not in the physics engine, which ignores their removal
+  return removeGameObject(objectID);
 }
 
 void GameEngine::setInvisible(int objectID) {
@@ -273,3 +418,21 @@ void GameEngine::onKeyPressed(Key key,
                               std::function<void(GameEngine &)> keyHandler) {
   keyHandlers.emplace(key, keyHandler);
 }
+
+void GameEngine::queryRegion(int x, int y, int width, int height,
+                             std::vector<int> &objectIDs) {
+  AABB region = {static_cast<double>(x), static_cast<double>(y),
+                 static_cast<double>(x + width),
+                 static_cast<double>(y + height)};
+  physicsEngine->queryRegion(region, objectIDs);
+}
+
+void GameEngine::raycast(double x, double y, double dx, double dy,
+                         std::vector<RaycastHit> &hits) {
+  physicsEngine->raycast(x, y, dx, dy, hits);
+}
+
+void GameEngine::nearest(double x, double y, int k,
+                         std::vector<int> &objectIDs) {
+  physicsEngine->nearest(x, y, k, objectIDs);
+}
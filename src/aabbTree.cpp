@@ -0,0 +1,483 @@
+#include "collisionEngine.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+AABBTreeCollisionEngine::AABBTreeCollisionEngine()
+    : AABBTreeCollisionEngine(AABB_TREE_MARGIN) {}
+
+AABBTreeCollisionEngine::AABBTreeCollisionEngine(double margin)
+    : margin(margin) {}
+
+std::vector<Collision> AABBTreeCollisionEngine::getAllCollisions() {
+  size_t chunkCount = collisionChunkCount(threadPool.get(), nodes.size());
+  if (chunkQueryStacks.size() < chunkCount) {
+    chunkQueryStacks.resize(chunkCount);
+  }
+
+  return collectCollisions(
+      threadPool.get(), nodes.size(),
+      [this](size_t begin, size_t end, size_t chunk,
+             std::vector<Collision> &collisions) {
+        for (size_t i = begin; i < end; i++) {
+          const AABBTreeNode &node = nodes[i];
+          if (node.height != 0) {
+            continue;
+          }
+
+          int leaf = i;
+          query(node.box, chunkQueryStacks[chunk], node.gameObject.get(),
+                [&](int other) {
+                  // Each pair is found from both leaves, keep the lower
+                  // indexed one
+                  const GameObject &otherObject = *nodes[other].gameObject;
+                  if (other > leaf &&
+                      filtersMatch(*node.gameObject, otherObject) &&
+                      hitboxesOverlap(*node.gameObject, otherObject)) {
+                    collisions.emplace_back(node.gameObject,
+                                            nodes[other].gameObject);
+                  }
+                });
+        }
+      });
+}
+
+std::vector<std::shared_ptr<GameObject>>
+AABBTreeCollisionEngine::getCollisionsWithObject(
+    std::shared_ptr<GameObject> &gameObject) {
+  std::vector<std::shared_ptr<GameObject>> colliders;
+
+  query(AABB::fromHitbox(*gameObject), queryStack, gameObject.get(),
+        [&](int other) {
+          const std::shared_ptr<GameObject> &collider =
+              nodes[other].gameObject;
+          if (collider != gameObject && filtersMatch(*gameObject, *collider) &&
+              hitboxesOverlap(*gameObject, *collider)) {
+            colliders.push_back(collider);
+          }
+        });
+
+  return colliders;
+}
+
+bool AABBTreeCollisionEngine::objectsCollided(
+    const std::shared_ptr<GameObject> &o1,
+    const std::shared_ptr<GameObject> &o2) {
+  return hitboxesOverlap(*o1, *o2);
+}
+
+void AABBTreeCollisionEngine::addGameObject(
+    std::shared_ptr<GameObject> gameObject) {
+  if (leaves.contains(gameObject->id)) {
+    return;
+  }
+
+  int leaf = allocateNode();
+  nodes[leaf].box = fattenBox(AABB::fromHitbox(*gameObject), 0, 0);
+  nodes[leaf].lastX = gameObject->position.x;
+  nodes[leaf].lastY = gameObject->position.y;
+  nodes[leaf].height = 0;
+  nodes[leaf].gameObject = gameObject;
+  nodes[leaf].categories = gameObject->collisionCategory;
+  nodes[leaf].masks = gameObject->collisionMask;
+
+  leaves.emplace(gameObject->id, leaf);
+  insertLeaf(leaf);
+}
+
+void AABBTreeCollisionEngine::removeGameObject(
+    std::shared_ptr<GameObject> &gameObject) {
+  auto result = leaves.find(gameObject->id);
+  if (result == leaves.end()) {
+    return;
+  }
+
+  removeLeaf(result->second);
+  freeNode(result->second);
+  leaves.erase(result);
+}
+
+void AABBTreeCollisionEngine::updateObjectQuadrants(
+    std::shared_ptr<GameObject> &previousState,
+    std::shared_ptr<GameObject> &newState) {
+  auto result = leaves.find(newState->id);
+  if (result == leaves.end()) {
+    addGameObject(newState);
+    return;
+  }
+
+  int leaf = result->second;
+  double dx = newState->position.x - nodes[leaf].lastX;
+  double dy = newState->position.y - nodes[leaf].lastY;
+  nodes[leaf].lastX = newState->position.x;
+  nodes[leaf].lastY = newState->position.y;
+
+  AABB hitbox = AABB::fromHitbox(*newState);
+  AABB box = fattenBox(hitbox, dx, dy);
+  if (nodes[leaf].box.contains(hitbox) &&
+      nodes[leaf].box.perimeter() <= box.perimeter() * AABB_TREE_SHRINK_RATIO) {
+    return;
+  }
+
+  removeLeaf(leaf);
+  nodes[leaf].box = box;
+  insertLeaf(leaf);
+}
+
+AABB AABBTreeCollisionEngine::fattenBox(const AABB &hitbox, double dx,
+                                        double dy) {
+  // Bodies jittering inside a pile swap direction every update, stretching
+  // their boxes would only add candidates without saving reinserts
+  AABB box = hitbox.expand(margin);
+  if (std::abs(dx) > margin) {
+    dx *= AABB_TREE_DISPLACEMENT_MULTIPLIER;
+    if (dx < 0) {
+      box.minX += dx;
+    } else {
+      box.maxX += dx;
+    }
+  }
+  if (std::abs(dy) > margin) {
+    dy *= AABB_TREE_DISPLACEMENT_MULTIPLIER;
+    if (dy < 0) {
+      box.minY += dy;
+    } else {
+      box.maxY += dy;
+    }
+  }
+  return box;
+}
+
+void AABBTreeCollisionEngine::setWorldSize(int width, int height) {}
+
+void AABBTreeCollisionEngine::updateObjectFilter(
+    std::shared_ptr<GameObject> &gameObject) {
+  auto result = leaves.find(gameObject->id);
+  if (result == leaves.end()) {
+    return;
+  }
+
+  int leaf = result->second;
+  nodes[leaf].categories = gameObject->collisionCategory;
+  nodes[leaf].masks = gameObject->collisionMask;
+  for (int node = nodes[leaf].parent; node != AABB_TREE_NULL_NODE;
+       node = nodes[node].parent) {
+    refitNode(node);
+  }
+}
+
+void AABBTreeCollisionEngine::setThreadPool(
+    std::shared_ptr<ThreadPool> threadPool) {
+  this->threadPool = threadPool;
+}
+
+void AABBTreeCollisionEngine::queryRegion(const AABB &region,
+                                          std::vector<int> &result) {
+  result.clear();
+
+  query(region, queryStack, nullptr, [&](int leaf) {
+    const GameObject &gameObject = *nodes[leaf].gameObject;
+    if (AABB::fromHitbox(gameObject).overlaps(region)) {
+      result.push_back(gameObject.id);
+    }
+  });
+}
+
+void AABBTreeCollisionEngine::raycast(double x, double y, double dx, double dy,
+                                      std::vector<RaycastHit> &hits) {
+  hits.clear();
+  if (root == AABB_TREE_NULL_NODE) {
+    return;
+  }
+
+  double time;
+  queryStack.clear();
+  queryStack.push_back(root);
+  while (!queryStack.empty()) {
+    int node = queryStack.back();
+    queryStack.pop_back();
+
+    if (!segmentHitsBox(nodes[node].box, x, y, dx, dy, time)) {
+      continue;
+    }
+
+    if (!nodes[node].isLeaf()) {
+      queryStack.push_back(nodes[node].child1);
+      queryStack.push_back(nodes[node].child2);
+    } else if (segmentHitsBox(AABB::fromHitbox(*nodes[node].gameObject), x, y,
+                              dx, dy, time)) {
+      hits.push_back({nodes[node].gameObject->id, time});
+    }
+  }
+
+  std::sort(hits.begin(), hits.end(),
+            [](const RaycastHit &h1, const RaycastHit &h2) {
+              return h1.time < h2.time || (h1.time == h2.time && h1.id < h2.id);
+            });
+}
+
+void AABBTreeCollisionEngine::nearest(double x, double y, int k,
+                                      std::vector<int> &result) {
+  nearestCandidates.clear();
+  if (k <= 0 || root == AABB_TREE_NULL_NODE) {
+    writeNearestCandidates(nearestCandidates, result);
+    return;
+  }
+
+  queryStack.clear();
+  queryStack.push_back(root);
+  while (!queryStack.empty()) {
+    int node = queryStack.back();
+    queryStack.pop_back();
+
+    // Skip subtrees farther than the k-th nearest object found
+    if (nearestCandidates.size() == static_cast<size_t>(k) &&
+        squaredDistanceToBox(nodes[node].box, x, y) >
+            nearestCandidates.front().first) {
+      continue;
+    }
+
+    if (nodes[node].isLeaf()) {
+      const GameObject &gameObject = *nodes[node].gameObject;
+      pushNearestCandidate(
+          nearestCandidates, k,
+          squaredDistanceToBox(AABB::fromHitbox(gameObject), x, y),
+          gameObject.id);
+      continue;
+    }
+
+    // Push the closer child last so it is visited first
+    int child1 = nodes[node].child1;
+    int child2 = nodes[node].child2;
+    if (squaredDistanceToBox(nodes[child1].box, x, y) <
+        squaredDistanceToBox(nodes[child2].box, x, y)) {
+      std::swap(child1, child2);
+    }
+    queryStack.push_back(child1);
+    queryStack.push_back(child2);
+  }
+
+  writeNearestCandidates(nearestCandidates, result);
+}
+
+int AABBTreeCollisionEngine::getHeight() {
+  return root == AABB_TREE_NULL_NODE ? 0 : nodes[root].height;
+}
+
+int AABBTreeCollisionEngine::allocateNode() {
+  int node;
+  if (freeNodes == AABB_TREE_NULL_NODE) {
+    node = nodes.size();
+    nodes.emplace_back();
+  } else {
+    node = freeNodes;
+    freeNodes = nodes[node].parent;
+  }
+
+  nodes[node].parent = AABB_TREE_NULL_NODE;
+  nodes[node].child1 = AABB_TREE_NULL_NODE;
+  nodes[node].child2 = AABB_TREE_NULL_NODE;
+  nodes[node].height = 0;
+  return node;
+}
+
+void AABBTreeCollisionEngine::freeNode(int node) {
+  nodes[node].gameObject = NULL;
+  nodes[node].height = -1;
+  nodes[node].parent = freeNodes;
+  freeNodes = node;
+}
+
+void AABBTreeCollisionEngine::insertLeaf(int leaf) {
+  if (root == AABB_TREE_NULL_NODE) {
+    root = leaf;
+    nodes[root].parent = AABB_TREE_NULL_NODE;
+    return;
+  }
+
+  // Descend towards the sibling whose merged box grows the perimeter least
+  const AABB leafBox = nodes[leaf].box;
+  int index = root;
+  while (!nodes[index].isLeaf()) {
+    const AABBTreeNode &node = nodes[index];
+    double perimeter = node.box.perimeter();
+    double combinedPerimeter = node.box.merge(leafBox).perimeter();
+
+    // Cost of pairing the leaf with this node, and of pushing it further down
+    double cost = 2 * combinedPerimeter;
+    double inheritanceCost = 2 * (combinedPerimeter - perimeter);
+
+    auto descendCost = [&](int child) {
+      const AABBTreeNode &childNode = nodes[child];
+      double merged = childNode.box.merge(leafBox).perimeter();
+      return childNode.isLeaf()
+                 ? merged + inheritanceCost
+                 : merged - childNode.box.perimeter() + inheritanceCost;
+    };
+    double cost1 = descendCost(node.child1);
+    double cost2 = descendCost(node.child2);
+
+    if (cost < cost1 && cost < cost2) {
+      break;
+    }
+    index = cost1 < cost2 ? node.child1 : node.child2;
+  }
+
+  int sibling = index;
+  int oldParent = nodes[sibling].parent;
+  int newParent = allocateNode();
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].box = nodes[sibling].box.merge(leafBox);
+  nodes[newParent].height = nodes[sibling].height + 1;
+  nodes[newParent].child1 = sibling;
+  nodes[newParent].child2 = leaf;
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+
+  if (oldParent == AABB_TREE_NULL_NODE) {
+    root = newParent;
+  } else if (nodes[oldParent].child1 == sibling) {
+    nodes[oldParent].child1 = newParent;
+  } else {
+    nodes[oldParent].child2 = newParent;
+  }
+
+  refitAncestors(nodes[leaf].parent);
+}
+
+void AABBTreeCollisionEngine::removeLeaf(int leaf) {
+  if (leaf == root) {
+    root = AABB_TREE_NULL_NODE;
+    return;
+  }
+
+  int parent = nodes[leaf].parent;
+  int grandParent = nodes[parent].parent;
+  int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2
+                                             : nodes[parent].child1;
+
+  freeNode(parent);
+  nodes[sibling].parent = grandParent;
+
+  if (grandParent == AABB_TREE_NULL_NODE) {
+    root = sibling;
+    return;
+  }
+
+  if (nodes[grandParent].child1 == parent) {
+    nodes[grandParent].child1 = sibling;
+  } else {
+    nodes[grandParent].child2 = sibling;
+  }
+  refitAncestors(grandParent);
+}
+
+void AABBTreeCollisionEngine::rotate(int a) {
+  int b = nodes[a].child1;
+  int c = nodes[a].child2;
+  if (nodes[a].height < 2) {
+    return;
+  }
+
+  // Swapping a child with one of its sibling's children keeps every leaf in
+  // the subtree, so pick the swap that shrinks the sibling's box the most
+  double bestReduction = 0;
+  int sibling = AABB_TREE_NULL_NODE;
+  int grandChild = AABB_TREE_NULL_NODE;
+
+  auto consider = [&](int child, int otherChild) {
+    if (nodes[otherChild].isLeaf()) {
+      return;
+    }
+    int g1 = nodes[otherChild].child1;
+    int g2 = nodes[otherChild].child2;
+    double perimeter = nodes[otherChild].box.perimeter();
+
+    double reduction1 =
+        perimeter - nodes[child].box.merge(nodes[g2].box).perimeter();
+    if (reduction1 > bestReduction) {
+      bestReduction = reduction1;
+      sibling = child;
+      grandChild = g1;
+    }
+    double reduction2 =
+        perimeter - nodes[child].box.merge(nodes[g1].box).perimeter();
+    if (reduction2 > bestReduction) {
+      bestReduction = reduction2;
+      sibling = child;
+      grandChild = g2;
+    }
+  };
+  consider(b, c);
+  consider(c, b);
+
+  if (sibling == AABB_TREE_NULL_NODE) {
+    return;
+  }
+
+  int parent = nodes[grandChild].parent;
+  if (nodes[a].child1 == sibling) {
+    nodes[a].child1 = grandChild;
+  } else {
+    nodes[a].child2 = grandChild;
+  }
+  if (nodes[parent].child1 == grandChild) {
+    nodes[parent].child1 = sibling;
+  } else {
+    nodes[parent].child2 = sibling;
+  }
+  nodes[grandChild].parent = a;
+  nodes[sibling].parent = parent;
+
+  refitNode(parent);
+}
+
+void AABBTreeCollisionEngine::refitNode(int node) {
+  const AABBTreeNode &child1 = nodes[nodes[node].child1];
+  const AABBTreeNode &child2 = nodes[nodes[node].child2];
+  nodes[node].height = 1 + std::max(child1.height, child2.height);
+  nodes[node].box = child1.box.merge(child2.box);
+  nodes[node].categories = child1.categories | child2.categories;
+  nodes[node].masks = child1.masks | child2.masks;
+}
+
+void AABBTreeCollisionEngine::refitAncestors(int node) {
+  while (node != AABB_TREE_NULL_NODE) {
+    rotate(node);
+    refitNode(node);
+
+    node = nodes[node].parent;
+  }
+}
+
+template <typename Callback>
+void AABBTreeCollisionEngine::query(const AABB &box, std::vector<int> &stack,
+                                    const GameObject *filter,
+                                    Callback callback) {
+  if (root == AABB_TREE_NULL_NODE) {
+    return;
+  }
+
+  stack.clear();
+  stack.push_back(root);
+  while (!stack.empty()) {
+    int node = stack.back();
+    stack.pop_back();
+
+    if (!nodes[node].box.overlaps(box)) {
+      continue;
+    }
+    if (filter && !filtersMatch(filter->collisionCategory, filter->collisionMask,
+                                nodes[node].categories, nodes[node].masks)) {
+      continue;
+    }
+
+    if (nodes[node].isLeaf()) {
+      callback(node);
+    } else {
+      stack.push_back(nodes[node].child1);
+      stack.push_back(nodes[node].child2);
+    }
+  }
+}
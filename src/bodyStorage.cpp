@@ -0,0 +1,123 @@
+#include "bodyStorage.h"
+#include <memory>
+#include <vector>
+
+void BodyStorage::add(const std::shared_ptr<GameObject> &gameObject) {
+  gameObject->slot = handles.size();
+  handles.push_back(gameObject);
+
+  positionX.push_back(0);
+  positionY.push_back(0);
+  speedX.push_back(0);
+  speedY.push_back(0);
+  accelerationX.push_back(0);
+  accelerationY.push_back(0);
+  mass.push_back(0);
+  width.push_back(0);
+  hitboxWidth.push_back(0);
+  hitboxHeight.push_back(0);
+  lastPositionX.push_back(0);
+  lastPositionY.push_back(0);
+  sleepFrames.push_back(0);
+  flags.push_back(0);
+
+  pull(gameObject->slot);
+}
+
+void BodyStorage::remove(GameObject &gameObject) {
+  int slot = gameObject.slot;
+  int last = handles.size() - 1;
+  gameObject.slot = -1;
+
+  if (slot != last) {
+    handles[slot] = std::move(handles[last]);
+    handles[slot]->slot = slot;
+
+    positionX[slot] = positionX[last];
+    positionY[slot] = positionY[last];
+    speedX[slot] = speedX[last];
+    speedY[slot] = speedY[last];
+    accelerationX[slot] = accelerationX[last];
+    accelerationY[slot] = accelerationY[last];
+    mass[slot] = mass[last];
+    width[slot] = width[last];
+    hitboxWidth[slot] = hitboxWidth[last];
+    hitboxHeight[slot] = hitboxHeight[last];
+    lastPositionX[slot] = lastPositionX[last];
+    lastPositionY[slot] = lastPositionY[last];
+    sleepFrames[slot] = sleepFrames[last];
+    flags[slot] = flags[last];
+  }
+
+  handles.pop_back();
+  positionX.pop_back();
+  positionY.pop_back();
+  speedX.pop_back();
+  speedY.pop_back();
+  accelerationX.pop_back();
+  accelerationY.pop_back();
+  mass.pop_back();
+  width.pop_back();
+  hitboxWidth.pop_back();
+  hitboxHeight.pop_back();
+  lastPositionX.pop_back();
+  lastPositionY.pop_back();
+  sleepFrames.pop_back();
+  flags.pop_back();
+}
+
+void BodyStorage::clear() {
+  for (std::shared_ptr<GameObject> &handle : handles) {
+    handle->slot = -1;
+  }
+
+  handles.clear();
+  positionX.clear();
+  positionY.clear();
+  speedX.clear();
+  speedY.clear();
+  accelerationX.clear();
+  accelerationY.clear();
+  mass.clear();
+  width.clear();
+  hitboxWidth.clear();
+  hitboxHeight.clear();
+  lastPositionX.clear();
+  lastPositionY.clear();
+  sleepFrames.clear();
+  flags.clear();
+}
+
+void BodyStorage::pull(int slot) {
+  const GameObject &gameObject = *handles[slot];
+
+  positionX[slot] = gameObject.position.x;
+  positionY[slot] = gameObject.position.y;
+  speedX[slot] = gameObject.speed.x;
+  speedY[slot] = gameObject.speed.y;
+  accelerationX[slot] = gameObject.acceleration.x;
+  accelerationY[slot] = gameObject.acceleration.y;
+  mass[slot] = gameObject.mass;
+  width[slot] = gameObject.width;
+  hitboxWidth[slot] = gameObject.hitboxWidth;
+  hitboxHeight[slot] = gameObject.hitboxHeight;
+  lastPositionX[slot] = gameObject.lastPosition.x;
+  lastPositionY[slot] = gameObject.lastPosition.y;
+  sleepFrames[slot] = gameObject.sleepFrames;
+  flags[slot] = (gameObject.sleeping ? BODY_SLEEPING : 0) |
+                (gameObject.fast ? BODY_FAST : 0);
+}
+
+void BodyStorage::push(int slot) {
+  GameObject &gameObject = *handles[slot];
+
+  gameObject.position.x = positionX[slot];
+  gameObject.position.y = positionY[slot];
+  gameObject.speed.x = speedX[slot];
+  gameObject.speed.y = speedY[slot];
+  gameObject.acceleration.x = accelerationX[slot];
+  gameObject.acceleration.y = accelerationY[slot];
+  gameObject.lastPosition.x = lastPositionX[slot];
+  gameObject.lastPosition.y = lastPositionY[slot];
+  gameObject.sleepFrames = sleepFrames[slot];
+}
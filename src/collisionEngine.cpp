@@ -1,7 +1,18 @@
 #include "collisionEngine.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <vector>
 
+bool hitboxesOverlap(const GameObject &o1, const GameObject &o2) {
+  return o1.position.x < o2.position.x + o2.hitboxWidth &&
+         o2.position.x < o1.position.x + o1.hitboxWidth &&
+         o1.position.y < o2.position.y + o2.hitboxHeight &&
+         o2.position.y < o1.position.y + o1.hitboxHeight;
+}
+
 std::vector<Collision> MockCollisionEngine::getAllCollisions() {
   std::vector<Collision> empty;
   return empty;
@@ -29,3 +40,652 @@ void MockCollisionEngine::removeGameObject(
 void MockCollisionEngine::updateObjectQuadrants(
     std::shared_ptr<GameObject> &previousState,
     std::shared_ptr<GameObject> &newState) {}
+
+size_t collisionChunkCount(ThreadPool *threadPool, size_t itemCount) {
+  // A few chunks per thread balance uneven chunks
+  size_t chunks = threadPool ? threadPool->getThreadCount() * 4 : 1;
+  return std::max<size_t>(1, std::min(chunks, itemCount));
+}
+
+std::vector<Collision> collectCollisions(
+    ThreadPool *threadPool, size_t itemCount,
+    const std::function<void(size_t, size_t, size_t, std::vector<Collision> &)>
+        &findCollisions) {
+  size_t chunkCount = collisionChunkCount(threadPool, itemCount);
+  if (chunkCount == 1) {
+    std::vector<Collision> collisions;
+    findCollisions(0, itemCount, 0, collisions);
+    return collisions;
+  }
+
+  std::vector<std::vector<Collision>> chunkCollisions(chunkCount);
+  threadPool->parallelFor(chunkCount, [&](size_t chunk) {
+    findCollisions(chunk * itemCount / chunkCount,
+                   (chunk + 1) * itemCount / chunkCount, chunk,
+                   chunkCollisions[chunk]);
+  });
+
+  size_t total = 0;
+  for (const std::vector<Collision> &chunk : chunkCollisions) {
+    total += chunk.size();
+  }
+
+  std::vector<Collision> collisions;
+  collisions.reserve(total);
+  for (std::vector<Collision> &chunk : chunkCollisions) {
+    std::move(chunk.begin(), chunk.end(), std::back_inserter(collisions));
+  }
+  return collisions;
+}
+
+double sweptTimeOfImpact(const AABB &moving, double dx, double dy,
+                         const AABB &target) {
+  if (moving.overlaps(target)) {
+    return 0;
+  }
+
+  double enter = 0;
+  double exit = 1;
+
+  auto sweepAxis = [&](double movingMin, double movingMax, double targetMin,
+                       double targetMax, double displacement) {
+    if (displacement == 0) {
+      return movingMin < targetMax && targetMin < movingMax;
+    }
+    double t1 = (targetMin - movingMax) / displacement;
+    double t2 = (targetMax - movingMin) / displacement;
+    enter = std::max(enter, std::min(t1, t2));
+    exit = std::min(exit, std::max(t1, t2));
+    return true;
+  };
+
+  if (!sweepAxis(moving.minX, moving.maxX, target.minX, target.maxX, dx) ||
+      !sweepAxis(moving.minY, moving.maxY, target.minY, target.maxY, dy) ||
+      enter >= exit) {
+    return 1;
+  }
+
+  return enter;
+}
+
+void MockCollisionEngine::setWorldSize(int width, int height) {}
+
+void MockCollisionEngine::updateObjectFilter(
+    std::shared_ptr<GameObject> &gameObject) {}
+
+void MockCollisionEngine::setThreadPool(
+    std::shared_ptr<ThreadPool> threadPool) {}
+
+void MockCollisionEngine::queryRegion(const AABB &region,
+                                      std::vector<int> &result) {
+  result.clear();
+}
+
+void MockCollisionEngine::raycast(double x, double y, double dx, double dy,
+                                  std::vector<RaycastHit> &hits) {
+  hits.clear();
+}
+
+void MockCollisionEngine::nearest(double x, double y, int k,
+                                  std::vector<int> &result) {
+  result.clear();
+}
+
+bool segmentHitsBox(const AABB &box, double x, double y, double dx, double dy,
+                    double &time) {
+  double enter = 0;
+  double exit = 1;
+
+  auto clipAxis = [&](double origin, double delta, double min, double max) {
+    if (delta == 0) {
+      return origin >= min && origin <= max;
+    }
+    double t1 = (min - origin) / delta;
+    double t2 = (max - origin) / delta;
+    enter = std::max(enter, std::min(t1, t2));
+    exit = std::min(exit, std::max(t1, t2));
+    return enter <= exit;
+  };
+
+  if (!clipAxis(x, dx, box.minX, box.maxX) ||
+      !clipAxis(y, dy, box.minY, box.maxY)) {
+    return false;
+  }
+
+  time = enter;
+  return true;
+}
+
+double squaredDistanceToBox(const AABB &box, double x, double y) {
+  double distanceX = std::max({box.minX - x, 0.0, x - box.maxX});
+  double distanceY = std::max({box.minY - y, 0.0, y - box.maxY});
+  return distanceX * distanceX + distanceY * distanceY;
+}
+
+void pushNearestCandidate(std::vector<NearestCandidate> &candidates, size_t k,
+                          double squaredDistance, int id) {
+  NearestCandidate candidate(squaredDistance, id);
+  if (candidates.size() < k) {
+    candidates.push_back(candidate);
+    std::push_heap(candidates.begin(), candidates.end());
+  } else if (candidate < candidates.front()) {
+    std::pop_heap(candidates.begin(), candidates.end());
+    candidates.back() = candidate;
+    std::push_heap(candidates.begin(), candidates.end());
+  }
+}
+
+void writeNearestCandidates(std::vector<NearestCandidate> &candidates,
+                            std::vector<int> &result) {
+  std::sort_heap(candidates.begin(), candidates.end());
+
+  result.clear();
+  for (const NearestCandidate &candidate : candidates) {
+    result.push_back(candidate.second);
+  }
+}
+
+XCollisionEngine::XCollisionEngine(int width, int height)
+    : XCollisionEngine(width, height, GRID_ROWS, GRID_COLUMNS) {
+  fixedSize = false;
+}
+
+XCollisionEngine::XCollisionEngine(int width, int height, int rows,
+                                   int columns)
+    : width(width), height(height), rows(std::max(rows, 1)),
+      columns(std::max(columns, 1)), fixedSize(true) {
+  rebuildGrid();
+}
+
+std::vector<Collision> XCollisionEngine::getAllCollisions() {
+  objectBoxes.resize(objects.size());
+  for (size_t i = 0; i < objects.size(); i++) {
+    objectBoxes[i] = AABB::fromHitbox(*objects[i]);
+  }
+
+  size_t chunkCount = collisionChunkCount(threadPool.get(), rows);
+  if (candidatePairs.size() < chunkCount) {
+    candidatePairs.resize(chunkCount);
+    collidingPairs.resize(chunkCount);
+  }
+
+  return collectCollisions(
+      threadPool.get(), rows,
+      [this](size_t begin, size_t end, size_t chunk,
+             std::vector<Collision> &collisions) {
+        findCollisionsInRows(begin, end, chunk, collisions);
+      });
+}
+
+std::vector<std::shared_ptr<GameObject>>
+XCollisionEngine::getCollisionsWithObject(
+    std::shared_ptr<GameObject> &gameObject) {
+  std::vector<std::shared_ptr<GameObject>> colliders;
+
+  // Read from the hitbox rather than looked up, the quadrants of an object
+  // are kept up to date with it before its collisions are checked
+  QuadrantRange range = getObjectQuadrants(*gameObject);
+
+  unsigned int mark = nextMark();
+  for (int row = range.minRow; row <= range.maxRow; row++) {
+    for (int column = range.minColumn; column <= range.maxColumn; column++) {
+      int quadrantIndex = getQuadrantIndex(row, column);
+      if (!filtersMatch(gameObject->collisionCategory,
+                        gameObject->collisionMask,
+                        quadrantCategories[quadrantIndex],
+                        quadrantMasks[quadrantIndex])) {
+        continue;
+      }
+
+      for (int objectIndex : gameGrid[quadrantIndex]) {
+        if (visitedMarks[objectIndex] == mark) {
+          continue;
+        }
+        visitedMarks[objectIndex] = mark;
+
+        const std::shared_ptr<GameObject> &other = objects[objectIndex];
+        if (other != gameObject && filtersMatch(*gameObject, *other) &&
+            hitboxesOverlap(*gameObject, *other)) {
+          colliders.push_back(other);
+        }
+      }
+    }
+  }
+
+  return colliders;
+}
+
+bool XCollisionEngine::objectsCollided(const std::shared_ptr<GameObject> &o1,
+                                       const std::shared_ptr<GameObject> &o2) {
+  return hitboxesOverlap(*o1, *o2);
+}
+
+void XCollisionEngine::addGameObject(std::shared_ptr<GameObject> gameObject) {
+  if (objectIndexes.contains(gameObject->id)) {
+    return;
+  }
+
+  int objectIndex = objects.size();
+  QuadrantRange range = getObjectQuadrants(*gameObject);
+
+  objects.push_back(gameObject);
+  objectQuadrants.push_back(range);
+  visitedMarks.push_back(0);
+  objectIndexes.emplace(gameObject->id, objectIndex);
+  objectSizeSum +=
+      std::max(gameObject->hitboxWidth, gameObject->hitboxHeight);
+
+  insertIntoQuadrants(objectIndex, range);
+  resizeGridIfNeeded();
+}
+
+void XCollisionEngine::removeGameObject(
+    std::shared_ptr<GameObject> &gameObject) {
+  auto index = objectIndexes.find(gameObject->id);
+  if (index == objectIndexes.end()) {
+    return;
+  }
+
+  int objectIndex = index->second;
+  const QuadrantRange range = objectQuadrants[objectIndex];
+  for (int row = range.minRow; row <= range.maxRow; row++) {
+    for (int column = range.minColumn; column <= range.maxColumn; column++) {
+      removeFromQuadrant(objectIndex, getQuadrantIndex(row, column));
+    }
+  }
+  objectIndexes.erase(index);
+  objectSizeSum -=
+      std::max(gameObject->hitboxWidth, gameObject->hitboxHeight);
+
+  // Swap the last object into the freed slot and renumber its quadrant entries
+  int lastIndex = objects.size() - 1;
+  if (objectIndex != lastIndex) {
+    objects[objectIndex] = std::move(objects[lastIndex]);
+    objectQuadrants[objectIndex] = objectQuadrants[lastIndex];
+    visitedMarks[objectIndex] = visitedMarks[lastIndex];
+    objectIndexes[objects[objectIndex]->id] = objectIndex;
+
+    const QuadrantRange &moved = objectQuadrants[objectIndex];
+    for (int row = moved.minRow; row <= moved.maxRow; row++) {
+      for (int column = moved.minColumn; column <= moved.maxColumn; column++) {
+        Quadrant &quadrant = gameGrid[getQuadrantIndex(row, column)];
+        std::replace(quadrant.begin(), quadrant.end(), lastIndex, objectIndex);
+      }
+    }
+  }
+
+  objects.pop_back();
+  objectQuadrants.pop_back();
+  visitedMarks.pop_back();
+  resizeGridIfNeeded();
+}
+
+void XCollisionEngine::updateObjectQuadrants(
+    std::shared_ptr<GameObject> &previousState,
+    std::shared_ptr<GameObject> &newState) {
+  auto index = objectIndexes.find(newState->id);
+  if (index == objectIndexes.end()) {
+    addGameObject(newState);
+    return;
+  }
+
+  int objectIndex = index->second;
+  const QuadrantRange oldRange = objectQuadrants[objectIndex];
+  const QuadrantRange newRange = getObjectQuadrants(*newState);
+  if (oldRange == newRange) {
+    return;
+  }
+
+  for (int row = oldRange.minRow; row <= oldRange.maxRow; row++) {
+    for (int column = oldRange.minColumn; column <= oldRange.maxColumn;
+         column++) {
+      if (!newRange.contains(row, column)) {
+        removeFromQuadrant(objectIndex, getQuadrantIndex(row, column));
+      }
+    }
+  }
+
+  for (int row = newRange.minRow; row <= newRange.maxRow; row++) {
+    for (int column = newRange.minColumn; column <= newRange.maxColumn;
+         column++) {
+      if (!oldRange.contains(row, column)) {
+        addToQuadrant(objectIndex, getQuadrantIndex(row, column));
+      }
+    }
+  }
+
+  objectQuadrants[objectIndex] = newRange;
+}
+
+void XCollisionEngine::updateObjectFilter(
+    std::shared_ptr<GameObject> &gameObject) {
+  if (objectIndexes.contains(gameObject->id)) {
+    removeGameObject(gameObject);
+    addGameObject(gameObject);
+  }
+}
+
+void XCollisionEngine::setThreadPool(std::shared_ptr<ThreadPool> threadPool) {
+  this->threadPool = threadPool;
+}
+
+void XCollisionEngine::queryRegion(const AABB &region,
+                                   std::vector<int> &result) {
+  result.clear();
+
+  QuadrantRange range = getBoxQuadrants(region);
+  unsigned int mark = nextMark();
+  for (int row = range.minRow; row <= range.maxRow; row++) {
+    for (int column = range.minColumn; column <= range.maxColumn; column++) {
+      for (int objectIndex : gameGrid[getQuadrantIndex(row, column)]) {
+        if (visitedMarks[objectIndex] == mark) {
+          continue;
+        }
+        visitedMarks[objectIndex] = mark;
+
+        if (AABB::fromHitbox(*objects[objectIndex]).overlaps(region)) {
+          result.push_back(objects[objectIndex]->id);
+        }
+      }
+    }
+  }
+}
+
+void XCollisionEngine::raycast(double x, double y, double dx, double dy,
+                               std::vector<RaycastHit> &hits) {
+  hits.clear();
+
+  AABB bounds = {std::min(x, x + dx), std::min(y, y + dy), std::max(x, x + dx),
+                 std::max(y, y + dy)};
+  QuadrantRange range = getBoxQuadrants(bounds);
+  unsigned int mark = nextMark();
+  double time;
+  for (int row = range.minRow; row <= range.maxRow; row++) {
+    for (int column = range.minColumn; column <= range.maxColumn; column++) {
+      // Skip the quadrants of the bounds that a diagonal ray misses
+      if (!segmentHitsBox(getQuadrantBox(row, column), x, y, dx, dy, time)) {
+        continue;
+      }
+
+      for (int objectIndex : gameGrid[getQuadrantIndex(row, column)]) {
+        if (visitedMarks[objectIndex] == mark) {
+          continue;
+        }
+        visitedMarks[objectIndex] = mark;
+
+        if (segmentHitsBox(AABB::fromHitbox(*objects[objectIndex]), x, y, dx,
+                           dy, time)) {
+          hits.push_back({objects[objectIndex]->id, time});
+        }
+      }
+    }
+  }
+
+  std::sort(hits.begin(), hits.end(),
+            [](const RaycastHit &h1, const RaycastHit &h2) {
+              return h1.time < h2.time || (h1.time == h2.time && h1.id < h2.id);
+            });
+}
+
+void XCollisionEngine::nearest(double x, double y, int k,
+                               std::vector<int> &result) {
+  nearestCandidates.clear();
+  if (k <= 0) {
+    result.clear();
+    return;
+  }
+
+  QuadrantRange start = getBoxQuadrants({x, y, x, y});
+  double quadrantSize = std::min(quadrantWidth, quadrantHeight);
+  unsigned int mark = nextMark();
+
+  // Visit rings of quadrants around the point's quadrant until the next ring
+  // is farther than the k-th nearest object found
+  for (int ring = 0; ring < std::max(rows, columns); ring++) {
+    double ringDistance = std::max(ring - 1, 0) * quadrantSize;
+    if (nearestCandidates.size() == static_cast<size_t>(k) &&
+        ringDistance * ringDistance > nearestCandidates.front().first) {
+      break;
+    }
+
+    for (int row = start.minRow - ring; row <= start.minRow + ring; row++) {
+      if (row < 0 || row >= rows) {
+        continue;
+      }
+
+      bool edgeRow = std::abs(row - start.minRow) == ring;
+      int step = edgeRow ? 1 : std::max(2 * ring, 1);
+      for (int column = start.minColumn - ring;
+           column <= start.minColumn + ring; column += step) {
+        if (column >= 0 && column < columns) {
+          visitNearestQuadrant(row, column, x, y, k, mark);
+        }
+      }
+    }
+  }
+
+  writeNearestCandidates(nearestCandidates, result);
+}
+
+void XCollisionEngine::setWorldSize(int width, int height) {
+  if (this->width == width && this->height == height) {
+    return;
+  }
+
+  this->width = width;
+  this->height = height;
+  if (fixedSize) {
+    rebuildGrid();
+  } else {
+    sizeGrid();
+  }
+}
+
+QuadrantRange XCollisionEngine::getObjectQuadrants(const GameObject &gameObject) {
+  return getBoxQuadrants(AABB::fromHitbox(gameObject));
+}
+
+QuadrantRange XCollisionEngine::getBoxQuadrants(const AABB &box) {
+  auto toColumn = [this](double x) {
+    return std::clamp(static_cast<int>(std::floor(x * inverseQuadrantWidth)),
+                      0, columns - 1);
+  };
+  auto toRow = [this](double y) {
+    return std::clamp(static_cast<int>(std::floor(y * inverseQuadrantHeight)),
+                      0, rows - 1);
+  };
+
+  return {toColumn(box.minX), toRow(box.minY), toColumn(box.maxX),
+          toRow(box.maxY)};
+}
+
+AABB XCollisionEngine::getQuadrantBox(int row, int column) {
+  const double infinity = std::numeric_limits<double>::infinity();
+  return {column == 0 ? -infinity : column * quadrantWidth,
+          row == 0 ? -infinity : row * quadrantHeight,
+          column == columns - 1 ? infinity : (column + 1) * quadrantWidth,
+          row == rows - 1 ? infinity : (row + 1) * quadrantHeight};
+}
+
+void XCollisionEngine::visitNearestQuadrant(int row, int column, double x,
+                                            double y, size_t k,
+                                            unsigned int mark) {
+  for (int objectIndex : gameGrid[getQuadrantIndex(row, column)]) {
+    if (visitedMarks[objectIndex] == mark) {
+      continue;
+    }
+    visitedMarks[objectIndex] = mark;
+
+    pushNearestCandidate(
+        nearestCandidates, k,
+        squaredDistanceToBox(AABB::fromHitbox(*objects[objectIndex]), x, y),
+        objects[objectIndex]->id);
+  }
+}
+
+int XCollisionEngine::getQuadrantIndex(int row, int column) {
+  return row * columns + column;
+}
+
+void XCollisionEngine::insertIntoQuadrants(int objectIndex,
+                                           const QuadrantRange &range) {
+  for (int row = range.minRow; row <= range.maxRow; row++) {
+    for (int column = range.minColumn; column <= range.maxColumn; column++) {
+      addToQuadrant(objectIndex, getQuadrantIndex(row, column));
+    }
+  }
+}
+
+void XCollisionEngine::addToQuadrant(int objectIndex, int quadrantIndex) {
+  gameGrid[quadrantIndex].push_back(objectIndex);
+  quadrantCategories[quadrantIndex] |= objects[objectIndex]->collisionCategory;
+  quadrantMasks[quadrantIndex] |= objects[objectIndex]->collisionMask;
+}
+
+void XCollisionEngine::removeFromQuadrant(int objectIndex, int quadrantIndex) {
+  Quadrant &quadrant = gameGrid[quadrantIndex];
+  auto result = std::find(quadrant.begin(), quadrant.end(), objectIndex);
+  if (result == quadrant.end()) {
+    return;
+  }
+  *result = quadrant.back();
+  quadrant.pop_back();
+
+  // Bits can not be taken out of a union. Stale ones only let a few more
+  // quadrants through the filter, so the union is reset once it is empty
+  if (quadrant.empty()) {
+    quadrantCategories[quadrantIndex] = 0;
+    quadrantMasks[quadrantIndex] = 0;
+  }
+}
+
+void XCollisionEngine::rebuildGrid() {
+  quadrantWidth = std::max(1.0, static_cast<double>(width) / columns);
+  quadrantHeight = std::max(1.0, static_cast<double>(height) / rows);
+  inverseQuadrantWidth = 1 / quadrantWidth;
+  inverseQuadrantHeight = 1 / quadrantHeight;
+
+  gameGrid.resize(rows * columns);
+  for (Quadrant &quadrant : gameGrid) {
+    quadrant.clear();
+  }
+  quadrantCategories.assign(rows * columns, 0);
+  quadrantMasks.assign(rows * columns, 0);
+
+  for (size_t i = 0; i < objects.size(); i++) {
+    objectQuadrants[i] = getObjectQuadrants(*objects[i]);
+    insertIntoQuadrants(i, objectQuadrants[i]);
+  }
+}
+
+void XCollisionEngine::sizeGrid() {
+  sizedObjectCount = objects.size();
+
+  double objectSize =
+      objects.empty() ? 0 : objectSizeSum / static_cast<double>(objects.size());
+  double quadrantSize = std::max(objectSize * GRID_CELL_OBJECT_SIZES, 1.0);
+  double worldWidth = std::max(width, 1);
+  double worldHeight = std::max(height, 1);
+
+  double quadrantCount =
+      (worldWidth / quadrantSize) * (worldHeight / quadrantSize);
+  double maxQuadrantCount = std::max<double>(
+      GRID_SIZE, GRID_CELLS_PER_OBJECT * static_cast<double>(objects.size()));
+  if (quadrantCount > maxQuadrantCount) {
+    quadrantSize *= std::sqrt(quadrantCount / maxQuadrantCount);
+  }
+
+  int newColumns = std::max(1, (int)std::ceil(worldWidth / quadrantSize));
+  int newRows = std::max(1, (int)std::ceil(worldHeight / quadrantSize));
+  if (newColumns != columns || newRows != rows) {
+    columns = newColumns;
+    rows = newRows;
+    rebuildGrid();
+  }
+}
+
+void XCollisionEngine::resizeGridIfNeeded() {
+  if (fixedSize) {
+    return;
+  }
+  size_t count = objects.size();
+  if (count >= sizedObjectCount * GRID_RESIZE_FACTOR ||
+      count * GRID_RESIZE_FACTOR <= sizedObjectCount) {
+    sizeGrid();
+  }
+}
+
+void XCollisionEngine::findCollisionsInRows(
+    int firstRow, int endRow, size_t chunk,
+    std::vector<Collision> &collisions) {
+  AABBPairBatch &batch = candidatePairs[chunk];
+  batch.clear();
+
+  for (int row = firstRow; row < endRow; row++) {
+    for (int column = 0; column < columns; column++) {
+      int quadrantIndex = getQuadrantIndex(row, column);
+      if (!filtersMatch(quadrantCategories[quadrantIndex],
+                        quadrantMasks[quadrantIndex],
+                        quadrantCategories[quadrantIndex],
+                        quadrantMasks[quadrantIndex])) {
+        continue;
+      }
+
+      const Quadrant &quadrant = gameGrid[quadrantIndex];
+      for (size_t i = 0; i < quadrant.size(); i++) {
+        const QuadrantRange &r1 = objectQuadrants[quadrant[i]];
+        const GameObject &o1 = *objects[quadrant[i]];
+
+        for (size_t j = i + 1; j < quadrant.size(); j++) {
+          const QuadrantRange &r2 = objectQuadrants[quadrant[j]];
+          if (!filtersMatch(o1, *objects[quadrant[j]])) {
+            continue;
+          }
+
+          // A pair sharing several quadrants is only reported by the first
+          // quadrant they have in common
+          if (std::max(r1.minRow, r2.minRow) != row ||
+              std::max(r1.minColumn, r2.minColumn) != column) {
+            continue;
+          }
+
+          batch.add(objectBoxes[quadrant[i]], quadrant[i],
+                    objectBoxes[quadrant[j]], quadrant[j]);
+        }
+      }
+    }
+  }
+
+  std::vector<CollidingPair> &overlapping = collidingPairs[chunk];
+  findOverlappingPairs(batch, overlapping);
+
+  collisions.reserve(overlapping.size());
+  for (const CollidingPair &pair : overlapping) {
+    collisions.emplace_back(objects[pair.index1], objects[pair.index2]);
+  }
+}
+
+unsigned int XCollisionEngine::nextMark() {
+  if (++currentMark == 0) {
+    std::fill(visitedMarks.begin(), visitedMarks.end(), 0);
+    currentMark = 1;
+  }
+  return currentMark;
+}
+
+CollisionEngine *
+CollisionEngineFactory::createCollisionEngine(CollisionEngineType type,
+                                              int worldWidth,
+                                              int worldHeight) {
+  switch (type) {
+  case UNIFORM_GRID:
+    return new XCollisionEngine(worldWidth, worldHeight);
+  case SWEEP_AND_PRUNE:
+    return new SweepAndPruneCollisionEngine();
+  case AABB_TREE:
+    return new AABBTreeCollisionEngine();
+  case MOCK_COLLISIONS:
+  default:
+    return new MockCollisionEngine();
+  }
+}
@@ -0,0 +1,176 @@
+#include "contactSolver.h"
+#include "aabb.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Closing speeds below this do not bounce, so resting objects stay at rest
+#define RESTITUTION_THRESHOLD 1.0
+// Overlap left alone by the position correction, to avoid jitter
+#define PENETRATION_SLOP 0.5
+// Fraction of the remaining overlap removed every frame
+#define POSITION_CORRECTION 0.8
+
+static uint64_t pairKey(int id1, int id2) {
+  return (static_cast<uint64_t>(std::min(id1, id2)) << 32) |
+         static_cast<uint32_t>(std::max(id1, id2));
+}
+
+void ContactSolver::addContact(const std::shared_ptr<GameObject> &o1,
+                               const std::shared_ptr<GameObject> &o2) {
+  Contact &contact = contacts[pairKey(o1->id, o2->id)];
+  if (!contact.body1) {
+    contact.body1 = o1->id < o2->id ? o1 : o2;
+    contact.body2 = o1->id < o2->id ? o2 : o1;
+  }
+  contact.touched = true;
+}
+
+void ContactSolver::removeContacts(int objectID) {
+  std::erase_if(contacts, [objectID](const auto &entry) {
+    return entry.second.body1->id == objectID ||
+           entry.second.body2->id == objectID;
+  });
+}
+
+void ContactSolver::solve(int iterations) {
+  activeKeys.clear();
+
+  for (auto iter = contacts.begin(); iter != contacts.end();) {
+    Contact &contact = iter->second;
+    if (contact.body1->sleeping && contact.body2->sleeping) {
+      iter++;
+      continue;
+    }
+
+    double inverseMassSum =
+        inverseMass(*contact.body1) + inverseMass(*contact.body2);
+    if (!contact.touched || inverseMassSum == 0 || !updateGeometry(contact)) {
+      iter = contacts.erase(iter);
+      continue;
+    }
+    contact.touched = false;
+    contact.normalMass = 1 / inverseMassSum;
+    activeKeys.emplace_back(iter->first, &contact);
+    iter++;
+  }
+
+  std::sort(activeKeys.begin(), activeKeys.end());
+  active.clear();
+  for (const auto &activeKey : activeKeys) {
+    active.push_back(activeKey.second);
+  }
+
+  for (Contact *contact : active) {
+    double closingSpeed =
+        (contact->body2->speed.x - contact->body1->speed.x) * contact->normalX +
+        (contact->body2->speed.y - contact->body1->speed.y) * contact->normalY;
+    double restitution =
+        std::max(contact->body1->restitution, contact->body2->restitution);
+    contact->velocityBias =
+        closingSpeed < -RESTITUTION_THRESHOLD ? -restitution * closingSpeed : 0;
+
+    applyImpulse(*contact, contact->normalImpulse);
+  }
+
+  for (int i = 0; i < iterations; i++) {
+    for (Contact *contact : active) {
+      double closingSpeed =
+          (contact->body2->speed.x - contact->body1->speed.x) *
+              contact->normalX +
+          (contact->body2->speed.y - contact->body1->speed.y) *
+              contact->normalY;
+      double impulse =
+          contact->normalMass * (contact->velocityBias - closingSpeed);
+
+      // Contacts can push but never pull
+      double total = std::max(contact->normalImpulse + impulse, 0.0);
+      applyImpulse(*contact, total - contact->normalImpulse);
+      contact->normalImpulse = total;
+    }
+  }
+
+  for (Contact *contact : active) {
+    double correction = std::max(contact->penetration - PENETRATION_SLOP, 0.0) *
+                        POSITION_CORRECTION * contact->normalMass;
+    double inverseMass1 = inverseMass(*contact->body1);
+    double inverseMass2 = inverseMass(*contact->body2);
+
+    contact->body1->position.x -= contact->normalX * correction * inverseMass1;
+    contact->body1->position.y -= contact->normalY * correction * inverseMass1;
+    contact->body2->position.x += contact->normalX * correction * inverseMass2;
+    contact->body2->position.y += contact->normalY * correction * inverseMass2;
+  }
+}
+
+void ContactSolver::saveContacts(std::vector<ContactSnapshot> &snapshots) {
+  for (auto iter = contacts.begin(); iter != contacts.end(); iter++) {
+    const Contact &contact = iter->second;
+    snapshots.push_back({contact.body1->id, contact.body2->id, contact.normalX,
+                         contact.normalY, contact.normalImpulse,
+                         contact.touched});
+  }
+}
+
+void ContactSolver::clearContacts() {
+  contacts.clear();
+  active.clear();
+}
+
+void ContactSolver::restoreContact(const ContactSnapshot &snapshot,
+                                   const std::shared_ptr<GameObject> &o1,
+                                   const std::shared_ptr<GameObject> &o2) {
+  Contact &contact = contacts[pairKey(snapshot.id1, snapshot.id2)];
+  contact.body1 = o1;
+  contact.body2 = o2;
+  contact.normalX = snapshot.normalX;
+  contact.normalY = snapshot.normalY;
+  contact.normalImpulse = snapshot.normalImpulse;
+  contact.touched = snapshot.touched;
+}
+
+bool ContactSolver::updateGeometry(Contact &contact) {
+  AABB box1 = AABB::fromHitbox(*contact.body1);
+  AABB box2 = AABB::fromHitbox(*contact.body2);
+
+  double overlapX =
+      std::min(box1.maxX, box2.maxX) - std::max(box1.minX, box2.minX);
+  double overlapY =
+      std::min(box1.maxY, box2.maxY) - std::max(box1.minY, box2.minY);
+  if (overlapX < 0 || overlapY < 0) {
+    return false;
+  }
+
+  // Push apart along the axis of least overlap
+  double normalX = 0, normalY = 0;
+  if (overlapX < overlapY) {
+    normalX = box2.minX + box2.maxX >= box1.minX + box1.maxX ? 1 : -1;
+    contact.penetration = overlapX;
+  } else {
+    normalY = box2.minY + box2.maxY >= box1.minY + box1.maxY ? 1 : -1;
+    contact.penetration = overlapY;
+  }
+
+  // The cached impulse only applies if the contact kept its normal
+  if (normalX != contact.normalX || normalY != contact.normalY) {
+    contact.normalImpulse = 0;
+  }
+  contact.normalX = normalX;
+  contact.normalY = normalY;
+  return true;
+}
+
+void ContactSolver::applyImpulse(Contact &contact, double impulse) {
+  double inverseMass1 = inverseMass(*contact.body1);
+  double inverseMass2 = inverseMass(*contact.body2);
+
+  contact.body1->speed.x -= contact.normalX * impulse * inverseMass1;
+  contact.body1->speed.y -= contact.normalY * impulse * inverseMass1;
+  contact.body2->speed.x += contact.normalX * impulse * inverseMass2;
+  contact.body2->speed.y += contact.normalY * impulse * inverseMass2;
+}
+
+double ContactSolver::inverseMass(const GameObject &gameObject) {
+  // Objects without mass are immovable
+  return gameObject.mass > 0 ? 1 / gameObject.mass : 0;
+}
@@ -0,0 +1,99 @@
+#include "damageRegion.h"
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+bool ScreenBounds::intersects(const ScreenBounds &bounds) const {
+  return !empty() && !bounds.empty() && x < bounds.x + bounds.width &&
+         bounds.x < x + width && y < bounds.y + bounds.height &&
+         bounds.y < y + height;
+}
+
+ScreenBounds ScreenBounds::unite(const ScreenBounds &bounds) const {
+  if (empty()) {
+    return bounds;
+  }
+  if (bounds.empty()) {
+    return *this;
+  }
+  int minX = std::min(x, bounds.x);
+  int minY = std::min(y, bounds.y);
+  int maxX = std::max(x + width, bounds.x + bounds.width);
+  int maxY = std::max(y + height, bounds.y + bounds.height);
+  return {minX, minY, maxX - minX, maxY - minY};
+}
+
+ScreenBounds ScreenBounds::intersect(const ScreenBounds &bounds) const {
+  int minX = std::max(x, bounds.x);
+  int minY = std::max(y, bounds.y);
+  int maxX = std::min(x + width, bounds.x + bounds.width);
+  int maxY = std::min(y + height, bounds.y + bounds.height);
+  if (maxX <= minX || maxY <= minY) {
+    return {};
+  }
+  return {minX, minY, maxX - minX, maxY - minY};
+}
+
+void DamageRegion::add(ScreenBounds bounds) {
+  if (bounds.empty()) {
+    return;
+  }
+
+  // Absorb every rectangle the new one overlaps, until it overlaps none
+  for (size_t i = 0; i < rectangles.size();) {
+    if (rectangles[i].intersects(bounds)) {
+      bounds = bounds.unite(rectangles[i]);
+      rectangles[i] = rectangles.back();
+      rectangles.pop_back();
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+
+  if (rectangles.size() < DAMAGE_MAX_RECTANGLES) {
+    rectangles.push_back(bounds);
+    return;
+  }
+
+  size_t closest = 0;
+  long closestGrowth = LONG_MAX;
+  for (size_t i = 0; i < rectangles.size(); i++) {
+    long growth = rectangles[i].unite(bounds).area() - rectangles[i].area();
+    if (growth < closestGrowth) {
+      closest = i;
+      closestGrowth = growth;
+    }
+  }
+  bounds = bounds.unite(rectangles[closest]);
+  rectangles[closest] = rectangles.back();
+  rectangles.pop_back();
+  add(bounds);
+}
+
+void DamageRegion::clear() { rectangles.clear(); }
+
+void DamageRegion::clip(const ScreenBounds &bounds) {
+  for (auto iter = rectangles.begin(); iter != rectangles.end(); iter++) {
+    *iter = iter->intersect(bounds);
+  }
+  std::erase_if(rectangles,
+                [](const ScreenBounds &rectangle) { return rectangle.empty(); });
+}
+
+long DamageRegion::area() const {
+  long total = 0;
+  for (auto iter = rectangles.begin(); iter != rectangles.end(); iter++) {
+    total += iter->area();
+  }
+  return total;
+}
+
+bool DamageRegion::intersects(const ScreenBounds &bounds) const {
+  for (auto iter = rectangles.begin(); iter != rectangles.end(); iter++) {
+    if (iter->intersects(bounds)) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,67 @@
+#include "frameScheduler.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+FrameScheduler::FrameScheduler() {
+  timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+}
+
+FrameScheduler::~FrameScheduler() {
+  if (timerFD != -1) {
+    close(timerFD);
+  }
+}
+
+void FrameScheduler::waitFor(int eventFD, std::chrono::nanoseconds timeout) {
+  if (timeout <= std::chrono::nanoseconds(0)) {
+    return;
+  }
+
+  struct pollfd fds[2];
+  int fdCount = 0;
+  if (eventFD != -1) {
+    fds[fdCount++] = {eventFD, POLLIN, 0};
+  }
+
+  int pollTimeout = -1;
+  if (timerFD != -1) {
+    struct itimerspec deadline = {};
+    deadline.it_value.tv_sec = timeout.count() / 1000000000;
+    deadline.it_value.tv_nsec = timeout.count() % 1000000000;
+    timerfd_settime(timerFD, 0, &deadline, nullptr);
+    fds[fdCount++] = {timerFD, POLLIN, 0};
+  } else {
+    // Round up, so the loop never wakes before the frame is due
+    pollTimeout =
+        std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+  }
+
+  std::chrono::time_point<std::chrono::steady_clock> start =
+      std::chrono::steady_clock::now();
+  while (poll(fds, fdCount, pollTimeout) == -1 && errno == EINTR) {
+  }
+  sleptThisFrame += std::chrono::steady_clock::now() - start;
+
+  if (timerFD != -1) {
+    // Disarm the timer and drop an expiration that was not waited for, so
+    // the next wait does not return early
+    struct itimerspec disarm = {};
+    timerfd_settime(timerFD, 0, &disarm, nullptr);
+    uint64_t expirations;
+    while (read(timerFD, &expirations, sizeof(expirations)) > 0) {
+    }
+  }
+}
+
+void FrameScheduler::endFrame() {
+  lastFrameSleep = sleptThisFrame;
+  sleptThisFrame = std::chrono::nanoseconds(0);
+}
+
+std::chrono::nanoseconds FrameScheduler::getFrameSleepTime() {
+  return lastFrameSleep;
+}
@@ -0,0 +1,164 @@
+#include "narrowphase.h"
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NARROWPHASE_X86
+#include <immintrin.h>
+#endif
+
+void AABBPairBatch::add(const AABB &box1, int i1, const AABB &box2, int i2) {
+  minX1.push_back(box1.minX);
+  minY1.push_back(box1.minY);
+  maxX1.push_back(box1.maxX);
+  maxY1.push_back(box1.maxY);
+  minX2.push_back(box2.minX);
+  minY2.push_back(box2.minY);
+  maxX2.push_back(box2.maxX);
+  maxY2.push_back(box2.maxY);
+  index1.push_back(i1);
+  index2.push_back(i2);
+}
+
+void AABBPairBatch::clear() {
+  for (std::vector<double> *coordinates :
+       {&minX1, &minY1, &maxX1, &maxY1, &minX2, &minY2, &maxX2, &maxY2}) {
+    coordinates->clear();
+  }
+  index1.clear();
+  index2.clear();
+}
+
+void AABBPairBatch::reserve(size_t size) {
+  for (std::vector<double> *coordinates :
+       {&minX1, &minY1, &maxX1, &maxY1, &minX2, &minY2, &maxX2, &maxY2}) {
+    coordinates->reserve(size);
+  }
+  index1.reserve(size);
+  index2.reserve(size);
+}
+
+/**
+ * Test pairs [begin, end) one at a time
+ *
+ * @return number of colliding pairs written at out
+ */
+static size_t overlapScalar(const AABBPairBatch &batch, size_t begin,
+                            size_t end, CollidingPair *out) {
+  size_t count = 0;
+  for (size_t i = begin; i < end; i++) {
+    if (batch.minX1[i] < batch.maxX2[i] && batch.minX2[i] < batch.maxX1[i] &&
+        batch.minY1[i] < batch.maxY2[i] && batch.minY2[i] < batch.maxY1[i]) {
+      out[count++] = {batch.index1[i], batch.index2[i]};
+    }
+  }
+  return count;
+}
+
+#ifdef NARROWPHASE_X86
+__attribute__((target("sse2"))) static size_t
+overlapSSE2(const AABBPairBatch &batch, CollidingPair *out) {
+  const size_t size = batch.size();
+  const size_t vectorEnd = size - size % 2;
+  size_t count = 0;
+
+  for (size_t i = 0; i < vectorEnd; i += 2) {
+    __m128d overlap = _mm_and_pd(
+        _mm_and_pd(_mm_cmplt_pd(_mm_loadu_pd(&batch.minX1[i]),
+                                _mm_loadu_pd(&batch.maxX2[i])),
+                   _mm_cmplt_pd(_mm_loadu_pd(&batch.minX2[i]),
+                                _mm_loadu_pd(&batch.maxX1[i]))),
+        _mm_and_pd(_mm_cmplt_pd(_mm_loadu_pd(&batch.minY1[i]),
+                                _mm_loadu_pd(&batch.maxY2[i])),
+                   _mm_cmplt_pd(_mm_loadu_pd(&batch.minY2[i]),
+                                _mm_loadu_pd(&batch.maxY1[i]))));
+
+    int mask = _mm_movemask_pd(overlap);
+    while (mask) {
+      int lane = __builtin_ctz(mask);
+      out[count++] = {batch.index1[i + lane], batch.index2[i + lane]};
+      mask &= mask - 1;
+    }
+  }
+
+  return count + overlapScalar(batch, vectorEnd, size, out + count);
+}
+
+__attribute__((target("avx2"))) static size_t
+overlapAVX2(const AABBPairBatch &batch, CollidingPair *out) {
+  const size_t size = batch.size();
+  const size_t vectorEnd = size - size % 4;
+  size_t count = 0;
+
+  for (size_t i = 0; i < vectorEnd; i += 4) {
+    __m256d overlap = _mm256_and_pd(
+        _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(&batch.minX1[i]),
+                                    _mm256_loadu_pd(&batch.maxX2[i]),
+                                    _CMP_LT_OQ),
+                      _mm256_cmp_pd(_mm256_loadu_pd(&batch.minX2[i]),
+                                    _mm256_loadu_pd(&batch.maxX1[i]),
+                                    _CMP_LT_OQ)),
+        _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(&batch.minY1[i]),
+                                    _mm256_loadu_pd(&batch.maxY2[i]),
+                                    _CMP_LT_OQ),
+                      _mm256_cmp_pd(_mm256_loadu_pd(&batch.minY2[i]),
+                                    _mm256_loadu_pd(&batch.maxY1[i]),
+                                    _CMP_LT_OQ)));
+
+    int mask = _mm256_movemask_pd(overlap);
+    while (mask) {
+      int lane = __builtin_ctz(mask);
+      out[count++] = {batch.index1[i + lane], batch.index2[i + lane]};
+      mask &= mask - 1;
+    }
+  }
+
+  return count + overlapScalar(batch, vectorEnd, size, out + count);
+}
+
+#endif // NARROWPHASE_X86
+
+NarrowphaseKernel detectNarrowphaseKernel() {
+  static const NarrowphaseKernel kernel = []() {
+#ifdef NARROWPHASE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return AVX2_KERNEL;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return SSE2_KERNEL;
+    }
+#endif
+    return SCALAR_KERNEL;
+  }();
+  return kernel;
+}
+
+void findOverlappingPairs(const AABBPairBatch &batch,
+                          std::vector<CollidingPair> &result) {
+  findOverlappingPairs(batch, result, detectNarrowphaseKernel());
+}
+
+void findOverlappingPairs(const AABBPairBatch &batch,
+                          std::vector<CollidingPair> &result,
+                          NarrowphaseKernel kernel) {
+  // Every pair may collide, so size for all of them and trim afterwards
+  result.resize(batch.size());
+
+  size_t count;
+  switch (kernel) {
+#ifdef NARROWPHASE_X86
+  case AVX2_KERNEL:
+    count = overlapAVX2(batch, result.data());
+    break;
+  case SSE2_KERNEL:
+    count = overlapSSE2(batch, result.data());
+    break;
+#endif
+  case SCALAR_KERNEL:
+  default:
+    count = overlapScalar(batch, 0, batch.size(), result.data());
+    break;
+  }
+
+  result.resize(count);
+}
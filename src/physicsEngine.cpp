@@ -1,42 +1,83 @@
 #include "physicsEngine.h"
 #include <algorithm>
 #include <chrono>
+#include <climits>
+#include <cmath>
+#include <functional>
 #include <memory>
+#include <span>
 
 #define FRAME_TIME_DIVISOR 300.0
 #define BORDER_ELASTICITY 0.5 // TODO add elasticity setting to engine interface
 #define FRICTION_CONSTANT 0.6
+#define MAX_SWEEP_SUBSTEPS 64
+// Objects moving less than this over a frame count as still
+#define SLEEP_DISTANCE 0.05
+// Frames an island has to stay still before it falls asleep
+#define SLEEP_FRAMES 30
+// Objects integrated per parallel task: 256 with 64 byte cache lines, so
+// each task covers 2 KiB, 32 whole cache lines, of every field array
+#define INTEGRATION_CHUNK_SIZE (32 * CACHE_LINE_SIZE / sizeof(double))
 
 XPhysicsEngine::XPhysicsEngine(double gravityPull, double jumpImpulse,
                                double walkingSpeed, int worldWidth,
                                int worldHeight, int frameTimeDuration,
                                CollisionEngine *collisionEngine,
                                bool collisions)
-    : jump(0, -jumpImpulse), gravity(0, gravityPull), walk(walkingSpeed, 0),
+    : gravity(0, gravityPull), jump(0, -jumpImpulse), walk(walkingSpeed, 0),
       worldWidth(worldWidth), worldHeight(worldHeight),
-      frameTimeDuration(frameTimeDuration) {
-  auto frameStartTime = std::chrono::high_resolution_clock::now();
+      frameTimeDuration(frameTimeDuration), collisions(collisions) {
+  frameStartTime = std::chrono::high_resolution_clock::now();
   this->collisionEngine = std::unique_ptr<CollisionEngine>(collisionEngine);
 }
 
 void XPhysicsEngine::setPlayer(std::shared_ptr<GameObject> player) {
+  if (this->player) {
+    collisionEngine->removeGameObject(this->player);
+  }
   this->player = player;
+  collisionEngine->addGameObject(player);
 }
 
 void XPhysicsEngine::addGameObject(std::shared_ptr<GameObject> gameObject) {
+  objectIndexes[gameObject->id] = gameObjects.size();
   gameObjects.push_back(gameObject);
+  collisionEngine->addGameObject(gameObject);
+  if (storageMode == ARRAY_STORAGE) {
+    bodies.add(gameObject);
+  }
 }
 
-void XPhysicsEngine::removePlayer() { this->player = NULL; }
+void XPhysicsEngine::removePlayer() {
+  if (player) {
+    collisionEngine->removeGameObject(player);
+    contactSolver.removeContacts(player->id);
+  }
+  this->player = NULL;
+}
 
 bool XPhysicsEngine::removeGameObject(std::shared_ptr<GameObject> &gameObject) {
-  auto result = std::find(gameObjects.begin(), gameObjects.end(), gameObject);
-
-  if (result == gameObjects.end()) {
+  auto index = objectIndexes.find(gameObject->id);
+  if (index == objectIndexes.end() ||
+      gameObjects[index->second] != gameObject) {
     return false;
   }
 
-  gameObjects.erase(result);
+  syncObject(*gameObject);
+  wakeObject(*gameObject);
+  collisionEngine->removeGameObject(gameObject);
+  contactSolver.removeContacts(gameObject->id);
+  if (gameObject->slot != -1) {
+    bodies.remove(*gameObject);
+  }
+  // Swap the last object into the freed place
+  size_t objectIndex = index->second;
+  objectIndexes.erase(index);
+  if (objectIndex != gameObjects.size() - 1) {
+    gameObjects[objectIndex] = std::move(gameObjects.back());
+    objectIndexes[gameObjects[objectIndex]->id] = objectIndex;
+  }
+  gameObjects.pop_back();
   return true;
 }
 
@@ -44,10 +85,11 @@ void XPhysicsEngine::playerJump() { playerApplyForce(jump); }
 
 void XPhysicsEngine::setPlayerAt(physics::Position2D position) {
   player->position = position;
+  player->previousPosition = position;
 }
 
 void XPhysicsEngine::playerApplyForce(physics::Force2D force) {
-  player->acceleration += force / player->mass;
+  player->acceleration += physics::Acceleration2D(force / player->mass);
 }
 
 void XPhysicsEngine::setPlayerXSpeed(double speed) { player->speed.x = speed; }
@@ -76,40 +118,76 @@ void XPhysicsEngine::objectJump(std::shared_ptr<GameObject> &gameObject) {
 
 void XPhysicsEngine::setObjectAt(std::shared_ptr<GameObject> &gameObject,
                                  physics::Position2D position) {
+  syncObject(*gameObject);
+  wakeObject(*gameObject);
   gameObject->position = position;
+  // Teleports are not interpolated
+  gameObject->previousPosition = position;
+  syncBody(*gameObject);
 }
 
 void XPhysicsEngine::objectApplyForce(std::shared_ptr<GameObject> &gameObject,
                                       physics::Force2D force) {
-  gameObject->acceleration += force / gameObject->mass;
+  syncObject(*gameObject);
+  wakeObject(*gameObject);
+  gameObject->acceleration +=
+      physics::Acceleration2D(force / gameObject->mass);
+  syncBody(*gameObject);
 }
 
 void XPhysicsEngine::setObjectXSpeed(std::shared_ptr<GameObject> &gameObject,
                                      double speed) {
+  syncObject(*gameObject);
+  wakeObject(*gameObject);
   gameObject->speed.x = speed;
+  syncBody(*gameObject);
 }
 
 void XPhysicsEngine::setObjectYSpeed(std::shared_ptr<GameObject> &gameObject,
                                      double speed) {
+  syncObject(*gameObject);
+  wakeObject(*gameObject);
   gameObject->speed.y = speed;
+  syncBody(*gameObject);
 }
 
 void XPhysicsEngine::setObjectSpeed(std::shared_ptr<GameObject> &gameObject,
                                     physics::Speed2D speed) {
+  syncObject(*gameObject);
+  wakeObject(*gameObject);
   gameObject->speed = speed;
+  syncBody(*gameObject);
 }
 
 void XPhysicsEngine::objectUpdateCoordinates(
     std::shared_ptr<GameObject> &gameObject) {
+  integrateObject(gameObject);
+
+  // Spatial queries read the collision engine, so it is kept up to date even
+  // with collisions off. Collision engines track the quadrants of each object
+  // themselves, so no copy of its previous state is needed
+  collisionEngine->updateObjectQuadrants(gameObject, gameObject);
+
+  // With a pool, collisions are found for every object at once after the tick
+  if (collisions && !threadPool) {
+    detectCollisions(gameObject);
+  }
+}
+
+void XPhysicsEngine::integrateObject(std::shared_ptr<GameObject> &gameObject) {
   gameObject->speed +=
       physics::Speed2D(gameObject->acceleration * frameTimeElapsed.count());
-  gameObject->position += physics::Position2D(
+  physics::Position2D displacement(
       gameObject->speed * (frameTimeElapsed.count() / FRAME_TIME_DIVISOR));
+  if (collisions && gameObject->fast) {
+    sweepObject(gameObject, displacement);
+  } else {
+    gameObject->position += displacement;
+  }
 
   gameObject->acceleration = physics::Acceleration2D(0, 0);
 
-  // TODO add elasticity setting to engine interface
-  if (isTouchingCeilling(gameObject)) {
+  if (ceillingWall && isTouchingCeilling(gameObject)) {
     setObjectAtCeillingLevel(gameObject);
     reboundFromYAxis(gameObject);
   }
@@ -119,26 +197,14 @@ void XPhysicsEngine::objectUpdateCoordinates(
     gameObject->acceleration.y = 0;
     gameObject->speed.y = 0;
   }
-  if (isTouchingLeftWall(gameObject)) {
+  if (leftWall && isTouchingLeftWall(gameObject)) {
     setObjectAtLeftWallLevel(gameObject);
     reboundFromXAxis(gameObject);
   }
-  if (isTouchingRightWall(gameObject)) {
+  if (rightWall && isTouchingRightWall(gameObject)) {
     setObjectAtRightWallLevel(gameObject);
     reboundFromXAxis(gameObject);
   }
-
-  if (collisions) {
-    std::shared_ptr<GameObject> copy = gameObject->clone();
-    collisionEngine->updateObjectQuadrants(copy, gameObject);
-
-    std::vector<std::shared_ptr<GameObject>> colliders =
-        collisionEngine->getCollisionsWithObject(gameObject);
-
-    for (auto iter = colliders.begin(); iter != colliders.end(); iter++) {
-      onCollision(gameObject, (*iter));
-    }
-  }
 }
 
 void XPhysicsEngine::objectApplyGravity(
@@ -167,6 +233,100 @@ void XPhysicsEngine::objectApplyFloorFriction(
   objectApplyForce(gameObject, friction);
 }
 
+void XPhysicsEngine::setObjectFast(std::shared_ptr<GameObject> &gameObject,
+                                   bool fast) {
+  syncObject(*gameObject);
+  gameObject->fast = fast;
+  syncBody(*gameObject);
+}
+
+void XPhysicsEngine::setObjectRestitution(
+    std::shared_ptr<GameObject> &gameObject, double restitution) {
+  gameObject->restitution = restitution;
+}
+
+void XPhysicsEngine::setObjectCollisionFilter(
+    std::shared_ptr<GameObject> &gameObject, uint32_t category,
+    uint32_t mask) {
+  wakeObject(*gameObject);
+  gameObject->collisionCategory = category;
+  gameObject->collisionMask = mask;
+  collisionEngine->updateObjectFilter(gameObject);
+}
+
+void XPhysicsEngine::applyCommands(std::span<const ObjectCommand> commands) {
+  // With array storage every game object has a slot. The player has neither,
+  // and goes first
+  const bool slotted = storageMode == ARRAY_STORAGE;
+
+  commandOrder.clear();
+  for (size_t i = 0; i < commands.size(); i++) {
+    if (player && player->id == commands[i].objectID) {
+      commandOrder.emplace_back(0, i);
+      continue;
+    }
+    auto index = objectIndexes.find(commands[i].objectID);
+    if (index == objectIndexes.end()) {
+      continue;
+    }
+    size_t position =
+        slotted ? gameObjects[index->second]->slot : index->second;
+    commandOrder.emplace_back(position + 1, i);
+  }
+  // Pairs sort by command index second, which keeps each object's commands
+  // in order
+  std::sort(commandOrder.begin(), commandOrder.end());
+
+  for (auto iter = commandOrder.begin(); iter != commandOrder.end(); iter++) {
+    const ObjectCommand &command = commands[iter->second];
+    std::shared_ptr<GameObject> &gameObject =
+        iter->first == 0 ? player
+        : slotted        ? bodies.handles[iter->first - 1]
+                         : gameObjects[iter->first - 1];
+
+    switch (command.type) {
+    case COMMAND_APPLY_FORCE:
+      objectApplyForce(gameObject, physics::Force2D(command.x, command.y));
+      break;
+    case COMMAND_SET_SPEED:
+      setObjectSpeed(gameObject, physics::Speed2D(command.x, command.y));
+      break;
+    case COMMAND_SET_POSITION:
+      setObjectAt(gameObject, physics::Position2D(command.x, command.y));
+      break;
+    }
+  }
+}
+
+void XPhysicsEngine::queueCommands(std::span<const ObjectCommand> commands) {
+  std::lock_guard<std::mutex> lock(commandMutex);
+  queuedCommands.insert(queuedCommands.end(), commands.begin(), commands.end());
+}
+
+void XPhysicsEngine::applyQueuedCommands() {
+  {
+    std::lock_guard<std::mutex> lock(commandMutex);
+    if (queuedCommands.empty()) {
+      return;
+    }
+    std::swap(queuedCommands, pendingCommands);
+  }
+
+  applyCommands(pendingCommands);
+  pendingCommands.clear();
+}
+
+std::shared_ptr<GameObject> *XPhysicsEngine::findObject(int objectID) {
+  if (player && player->id == objectID) {
+    return &player;
+  }
+  auto index = objectIndexes.find(objectID);
+  if (index == objectIndexes.end()) {
+    return nullptr;
+  }
+  return &gameObjects[index->second];
+}
+
 void XPhysicsEngine::playerSetWalkingSpeed(double speed) { walk.x = speed; }
 
 void XPhysicsEngine::playerSetWalkingLeft() {
@@ -201,9 +361,32 @@ void XPhysicsEngine::playerUnsetWalkingRight() {
   playerWalkingRight = false;
 }
 
+
 void XPhysicsEngine::setCollisionsOn() { collisions = true; }
 void XPhysicsEngine::setCollisionsOff() { collisions = false; }
 
+void XPhysicsEngine::setSolverIterations(int iterations) {
+  solverIterations = std::max(iterations, 1);
+}
+
+void XPhysicsEngine::setStorageMode(PhysicsStorageMode mode) {
+  if (storageMode == mode) {
+    return;
+  }
+
+  // Once up to date, game objects hold the same state as their slots, so
+  // switching only has to fill or empty the storage
+  syncObjects();
+  storageMode = mode;
+  if (mode == ARRAY_STORAGE) {
+    for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
+      bodies.add(*iter);
+    }
+  } else {
+    bodies.clear();
+  }
+}
+
 void XPhysicsEngine::addObserver(std::shared_ptr<Observer> observer) {
   observers.push_back(observer);
 }
@@ -214,12 +397,56 @@ void XPhysicsEngine::removeObserver(std::shared_ptr<Observer> &observer) {
 }
 
 void XPhysicsEngine::notifyAll() {
+  // Observers draw or read the game objects
+  if (!observers.empty()) {
+    syncObjects();
+  }
   for (auto iter = observers.begin(); iter != observers.end(); iter++) {
     (*iter)->onNotified();
   }
 }
 
+void XPhysicsEngine::setThreadPool(std::shared_ptr<ThreadPool> threadPool) {
+  this->threadPool = threadPool;
+  collisionEngine->setThreadPool(threadPool);
+}
+
+void XPhysicsEngine::setFixedTimestep(int stepsPerSecond,
+                                     int maxCatchUpSteps) {
+  fixedTimestep = true;
+  fixedStepDuration = std::chrono::nanoseconds(std::chrono::seconds(1)) /
+                      std::max(stepsPerSecond, 1);
+  this->maxCatchUpSteps = std::max(maxCatchUpSteps, 1);
+  accumulator = std::chrono::nanoseconds(0);
+  lastStepTime = std::chrono::steady_clock::now();
+  lastDrawTime = lastStepTime;
+  interpolationAlpha = 1;
+
+  // Nothing to interpolate from until the first step
+  if (player) {
+    player->previousPosition = player->position;
+  }
+  for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
+    (*iter)->previousPosition = (*iter)->position;
+  }
+}
+
+void XPhysicsEngine::setVariableTimestep() {
+  fixedTimestep = false;
+  interpolationAlpha = 1;
+  frameStartTime = std::chrono::high_resolution_clock::now();
+}
+
+double XPhysicsEngine::getInterpolationAlpha() { return interpolationAlpha; }
+
 void XPhysicsEngine::tick() {
+  applyQueuedCommands();
+
+  if (fixedTimestep) {
+    tickFixed();
+    return;
+  }
+
   frameEndTime = std::chrono::high_resolution_clock::now();
   frameTimeElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
       frameEndTime - frameStartTime);
@@ -230,20 +457,196 @@ void XPhysicsEngine::tick() {
 
   frameStartTime = std::chrono::high_resolution_clock::now();
 
-  if (playerWalkingRight) {
-    player->speed.x = walk.x;
+  step();
+  notifyAll();
+}
+
+std::chrono::nanoseconds XPhysicsEngine::getTimeUntilNextTick() {
+  std::chrono::nanoseconds remaining;
+  if (fixedTimestep) {
+    std::chrono::time_point<std::chrono::steady_clock> now =
+        std::chrono::steady_clock::now();
+    std::chrono::nanoseconds untilStep =
+        fixedStepDuration - accumulator - (now - lastStepTime);
+    // Drawing waits for strictly more than a frame
+    std::chrono::nanoseconds untilDraw =
+        std::chrono::milliseconds(frameTimeDuration) - (now - lastDrawTime) +
+        std::chrono::nanoseconds(1);
+    remaining = std::min(untilStep, untilDraw);
+  } else {
+    // Frames are counted in whole milliseconds and last strictly more than
+    // frameTimeDuration
+    remaining = std::chrono::milliseconds(frameTimeDuration + 1) -
+                (std::chrono::high_resolution_clock::now() - frameStartTime);
+  }
+  return std::max(remaining, std::chrono::nanoseconds(0));
+}
+
+void XPhysicsEngine::stepBy(double milliseconds) {
+  applyQueuedCommands();
+
+  frameTimeElapsed = std::chrono::duration<double, std::milli>(milliseconds);
+  step();
+  notifyAll();
+}
+
+void XPhysicsEngine::saveSnapshot(WorldSnapshot &snapshot) {
+  syncObjects();
+
+  auto save = [](const GameObject &gameObject, ObjectSnapshot &object) {
+    object = {gameObject.id,
+              gameObject.position.x,
+              gameObject.position.y,
+              gameObject.speed.x,
+              gameObject.speed.y,
+              gameObject.acceleration.x,
+              gameObject.acceleration.y,
+              gameObject.lastPosition.x,
+              gameObject.lastPosition.y,
+              gameObject.previousPosition.x,
+              gameObject.previousPosition.y,
+              gameObject.sleepFrames,
+              gameObject.island,
+              gameObject.sleeping};
+  };
+
+  snapshot.hasPlayer = player != nullptr;
+  if (player) {
+    save(*player, snapshot.player);
+  }
+  snapshot.playerWalkingLeft = playerWalkingLeft;
+  snapshot.playerWalkingRight = playerWalkingRight;
+  snapshot.nextIslandID = nextIslandID;
+  snapshot.accumulator = accumulator;
+  snapshot.interpolationAlpha = interpolationAlpha;
+
+  snapshot.objects.resize(gameObjects.size());
+  for (size_t i = 0; i < gameObjects.size(); i++) {
+    save(*gameObjects[i], snapshot.objects[i]);
+  }
+
+  snapshot.contacts.clear();
+  contactSolver.saveContacts(snapshot.contacts);
+}
+
+bool XPhysicsEngine::restoreSnapshot(const WorldSnapshot &snapshot) {
+  if (snapshot.hasPlayer != (player != nullptr) ||
+      (player && player->id != snapshot.player.id) ||
+      snapshot.objects.size() != gameObjects.size()) {
+    return false;
+  }
+  for (const ObjectSnapshot &object : snapshot.objects) {
+    if (!objectIndexes.contains(object.id)) {
+      return false;
+    }
+  }
+
+  auto restore = [](const ObjectSnapshot &object, GameObject &gameObject) {
+    gameObject.position = physics::Position2D(object.positionX, object.positionY);
+    gameObject.speed = physics::Speed2D(object.speedX, object.speedY);
+    gameObject.acceleration =
+        physics::Acceleration2D(object.accelerationX, object.accelerationY);
+    gameObject.lastPosition =
+        physics::Position2D(object.lastPositionX, object.lastPositionY);
+    gameObject.previousPosition =
+        physics::Position2D(object.previousPositionX, object.previousPositionY);
+    gameObject.sleepFrames = object.sleepFrames;
+    gameObject.island = object.island;
+    gameObject.sleeping = object.sleeping;
+  };
+
+  // Islands are rebuilt from the sleeping objects
+  sleepingIslands.clear();
+  if (player) {
+    restore(snapshot.player, *player);
+    collisionEngine->updateObjectQuadrants(player, player);
+  }
+  for (const ObjectSnapshot &object : snapshot.objects) {
+    std::shared_ptr<GameObject> &gameObject =
+        gameObjects[objectIndexes[object.id]];
+    restore(object, *gameObject);
+    collisionEngine->updateObjectQuadrants(gameObject, gameObject);
+    syncBody(*gameObject);
+    if (gameObject->sleeping) {
+      sleepingIslands[gameObject->island].push_back(gameObject);
+    }
+  }
+  // Every slot was refilled from its restored game object
+  bodiesAhead = false;
+
+  playerWalkingLeft = snapshot.playerWalkingLeft;
+  playerWalkingRight = snapshot.playerWalkingRight;
+  nextIslandID = snapshot.nextIslandID;
+  accumulator = snapshot.accumulator;
+  interpolationAlpha = snapshot.interpolationAlpha;
+
+  contactSolver.clearContacts();
+  for (const ContactSnapshot &contact : snapshot.contacts) {
+    contactSolver.restoreContact(contact, *findObject(contact.id1),
+                                 *findObject(contact.id2));
+  }
+  return true;
+}
+
+void XPhysicsEngine::tickFixed() {
+  std::chrono::time_point<std::chrono::steady_clock> now =
+      std::chrono::steady_clock::now();
+  accumulator += now - lastStepTime;
+  lastStepTime = now;
+
+  frameTimeElapsed = fixedStepDuration;
+  for (int steps = 0;
+       steps < maxCatchUpSteps && accumulator >= fixedStepDuration; steps++) {
+    syncObjects();
+    if (player) {
+      player->previousPosition = player->position;
+    }
+    for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
+      (*iter)->previousPosition = (*iter)->position;
+    }
+
+    step();
+    accumulator -= fixedStepDuration;
   }
-  if (playerWalkingLeft) {
-    player->speed.x = -walk.x;
+
+  // Past the catch-up limit, drop the backlog rather than fall further behind
+  // on every tick
+  if (accumulator >= fixedStepDuration) {
+    accumulator %= fixedStepDuration;
   }
-  if (playerWalkingLeft && playerWalkingRight) {
-    player->speed.x = 0;
+  interpolationAlpha = static_cast<double>(accumulator.count()) /
+                       fixedStepDuration.count();
+
+  if (now - lastDrawTime <= std::chrono::milliseconds(frameTimeDuration)) {
+    return;
   }
+  lastDrawTime = now;
+  notifyAll();
+}
 
-  playerApplyGravity();
-  playerUpdateCoordinates();
-  if (isTouchingFloor(player)) {
-    playerApplyFloorFriction();
+void XPhysicsEngine::step() {
+  // Collisions are found between game objects
+  if (collisions) {
+    syncObjects();
+  }
+
+  // Worlds simulated without a display may have no player
+  if (player) {
+    if (playerWalkingRight) {
+      player->speed.x = walk.x;
+    }
+    if (playerWalkingLeft) {
+      player->speed.x = -walk.x;
+    }
+    if (playerWalkingLeft && playerWalkingRight) {
+      player->speed.x = 0;
+    }
+
+    playerApplyGravity();
+    playerUpdateCoordinates();
+    if (isTouchingFloor(player)) {
+      playerApplyFloorFriction();
+    }
   }
   //  std::cout << "Player state:" << std::endl;
   //  std::cout << "Position: X = " << player->position.x
@@ -255,23 +658,52 @@ void XPhysicsEngine::tick() {
   //            << " Y = " << player->acceleration.y << std::endl;
   //  std::cout << "Mass: " << player->mass << std::endl << std::endl;
   //
-  for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
-    objectApplyGravity(*iter);
-    objectUpdateCoordinates(*iter);
-    objectApplyFloorFriction(*iter);
+  if (storageMode == ARRAY_STORAGE) {
+    tickBodies();
+  } else {
+    tickObjects();
   }
 
-  notifyAll();
+  if (collisions) {
+    if (threadPool) {
+      detectAllCollisions();
+    }
+    resolveCollisions();
+  }
+  updateSleeping();
 }
 
 void XPhysicsEngine::setWorldSize(int width, int height) {
+  // Objects resting on the borders have to follow them
+  while (!sleepingIslands.empty()) {
+    wakeObject(*sleepingIslands.begin()->second.front());
+  }
+
   worldWidth = width;
   worldHeight = height;
+  collisionEngine->setWorldSize(width, height);
   //  std::cout << "Setting world size!" << std::endl;
 }
 int XPhysicsEngine::getWorldWidth() { return worldWidth; }
 int XPhysicsEngine::getWorldHeight() { return worldHeight; }
 
+void XPhysicsEngine::queryRegion(const AABB &region, std::vector<int> &result) {
+  syncObjects();
+  collisionEngine->queryRegion(region, result);
+}
+
+void XPhysicsEngine::raycast(double x, double y, double dx, double dy,
+                             std::vector<RaycastHit> &hits) {
+  syncObjects();
+  collisionEngine->raycast(x, y, dx, dy, hits);
+}
+
+void XPhysicsEngine::nearest(double x, double y, int k,
+                             std::vector<int> &result) {
+  syncObjects();
+  collisionEngine->nearest(x, y, k, result);
+}
+
 bool XPhysicsEngine::isTouchingCeilling(
     std::shared_ptr<GameObject> &gameObject) {
   return gameObject->position.y <= 0;
@@ -323,7 +755,493 @@ void XPhysicsEngine::reboundFromXAxis(std::shared_ptr<GameObject> &gameObject) {
   gameObject->speed.x = -gameObject->speed.x;
 }
 
+void XPhysicsEngine::tickObjects() {
+  // Objects only affect each other through collisions, which a pool finds
+  // once every object has moved. Each one is then integrated on its own and
+  // the collision engine catches up after, except fast objects that sweep
+  // through the others
+  if (!threadPool) {
+    for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
+      if ((*iter)->sleeping) {
+        continue;
+      }
+      objectApplyGravity(*iter);
+      objectUpdateCoordinates(*iter);
+      objectApplyFloorFriction(*iter);
+    }
+    return;
+  }
+
+  forEachChunk(gameObjects.size(), [this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      std::shared_ptr<GameObject> &gameObject = gameObjects[i];
+      if (gameObject->sleeping || (collisions && gameObject->fast)) {
+        continue;
+      }
+      objectApplyGravity(gameObject);
+      integrateObject(gameObject);
+      objectApplyFloorFriction(gameObject);
+    }
+  });
+
+  for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
+    if (!(*iter)->sleeping && !(collisions && (*iter)->fast)) {
+      collisionEngine->updateObjectQuadrants(*iter, *iter);
+    }
+  }
+
+  if (!collisions) {
+    return;
+  }
+  for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
+    if (!(*iter)->sleeping && (*iter)->fast) {
+      objectApplyGravity(*iter);
+      objectUpdateCoordinates(*iter);
+      objectApplyFloorFriction(*iter);
+    }
+  }
+}
+
+void XPhysicsEngine::tickBodies() {
+  // Without collisions, bodies only need their game objects once something
+  // reads them
+  if (!collisions) {
+    forEachChunk(bodies.size(), [this](size_t begin, size_t end) {
+      integrateBodies(begin, end);
+    });
+    bodiesAhead = true;
+    return;
+  }
+
+  // Fast bodies are swept one by one further down
+  const unsigned char skipped = BODY_SLEEPING | BODY_FAST;
+
+  // Collisions found below can wake bodies further down, which were not
+  // integrated in their slots
+  tickFlags.assign(bodies.flags.begin(), bodies.flags.end());
+
+  forEachChunk(bodies.size(), [this](size_t begin, size_t end) {
+    integrateBodies(begin, end);
+  });
+
+  // Bodies are mirrored to their game objects one at a time, so the
+  // collisions found are the same as when integrating game objects directly
+  for (size_t i = 0; i < bodies.size(); i++) {
+    if (bodies.flags[i] & BODY_SLEEPING) {
+      continue;
+    }
+    std::shared_ptr<GameObject> &gameObject = bodies.handles[i];
+
+    // Woken up during this tick, the slot was refilled from its game object
+    // after the integration
+    if ((bodies.flags[i] & skipped) || (tickFlags[i] & BODY_SLEEPING)) {
+      if (threadPool) {
+        continue;
+      }
+      objectApplyGravity(gameObject);
+      objectUpdateCoordinates(gameObject);
+      objectApplyFloorFriction(gameObject);
+      bodies.pull(i);
+      continue;
+    }
+
+    bodies.push(i);
+    bodies.flags[i] &= ~BODY_MOVED;
+    collisionEngine->updateObjectQuadrants(gameObject, gameObject);
+    if (!threadPool) {
+      detectCollisions(gameObject);
+    }
+  }
+
+  if (!threadPool) {
+    return;
+  }
+  // Collisions are found after the tick, so nothing woke up above. Fast
+  // bodies sweep through the others once they have all moved, as tickObjects
+  // does
+  for (size_t i = 0; i < bodies.size(); i++) {
+    if ((bodies.flags[i] & BODY_SLEEPING) || !(bodies.flags[i] & BODY_FAST)) {
+      continue;
+    }
+    std::shared_ptr<GameObject> &gameObject = bodies.handles[i];
+    objectApplyGravity(gameObject);
+    objectUpdateCoordinates(gameObject);
+    objectApplyFloorFriction(gameObject);
+    bodies.pull(i);
+  }
+}
+
+void XPhysicsEngine::integrateBodies(size_t begin, size_t end) {
+  // Sleeping bodies keep their slots, so awake ones come in stretches
+  size_t awakeBegin = begin;
+  while (awakeBegin < end) {
+    while (awakeBegin < end && (bodies.flags[awakeBegin] & BODY_SLEEPING)) {
+      awakeBegin++;
+    }
+    size_t awakeEnd = awakeBegin;
+    while (awakeEnd < end && !(bodies.flags[awakeEnd] & BODY_SLEEPING)) {
+      awakeEnd++;
+    }
+    if (awakeBegin < awakeEnd) {
+      integrateAwakeBodies(awakeBegin, awakeEnd);
+    }
+    awakeBegin = awakeEnd;
+  }
+}
+
+void XPhysicsEngine::integrateAwakeBodies(size_t begin, size_t end) {
+  const double elapsed = frameTimeElapsed.count();
+  const double step = elapsed / FRAME_TIME_DIVISOR;
+  const size_t count = end - begin;
+
+  std::span<double> positionX =
+      std::span(bodies.positionX).subspan(begin, count);
+  std::span<double> positionY =
+      std::span(bodies.positionY).subspan(begin, count);
+  std::span<double> speedX = std::span(bodies.speedX).subspan(begin, count);
+  std::span<double> speedY = std::span(bodies.speedY).subspan(begin, count);
+  std::span<double> accelerationX =
+      std::span(bodies.accelerationX).subspan(begin, count);
+  std::span<double> accelerationY =
+      std::span(bodies.accelerationY).subspan(begin, count);
+
+  // Same steps as objectApplyGravity, objectUpdateCoordinates and
+  // objectApplyFloorFriction, one field array at a time. Fast slots are
+  // integrated too, so the passes stay branch-free: they are pulled back from
+  // their game objects before being read again
+  physics::addScalar(gravity.x, accelerationX);
+  physics::addScalar(gravity.y, accelerationY);
+  physics::axpy(elapsed, accelerationX, speedX);
+  physics::axpy(elapsed, accelerationY, speedY);
+  physics::axpy(step, speedX, positionX);
+  physics::axpy(step, speedY, positionY);
+
+  for (size_t i = begin; i < end; i++) {
+    double positionX = bodies.positionX[i];
+    double positionY = bodies.positionY[i];
+    double speedX = bodies.speedX[i];
+    double speedY = bodies.speedY[i];
+    double accelerationX = 0;
+
+    if (ceillingWall && positionY <= 0) {
+      positionY = 0;
+      speedY = -speedY;
+    }
+    if (positionY + bodies.hitboxHeight[i] >= worldHeight) {
+      positionY = worldHeight - bodies.hitboxHeight[i];
+      speedY = 0;
+    }
+    if (leftWall && positionX <= 0) {
+      positionX = 0;
+      speedX = -speedX;
+    }
+    if (rightWall && positionX + bodies.width[i] >= worldWidth) {
+      positionX = worldWidth - bodies.hitboxWidth[i];
+      speedX = -speedX;
+    }
+
+    if (speedX != 0) {
+      double mass = bodies.mass[i];
+      double maxFriction = mass * gravity.y * FRICTION_CONSTANT;
+      double forceToStopXMovement = (speedX / elapsed) * mass;
+      double friction =
+          std::min(std::abs(maxFriction), std::abs(forceToStopXMovement));
+      accelerationX = (speedX > 0 ? -friction : friction) / mass;
+    }
+
+    bodies.positionX[i] = positionX;
+    bodies.positionY[i] = positionY;
+    bodies.speedX[i] = speedX;
+    bodies.speedY[i] = speedY;
+    bodies.accelerationX[i] = accelerationX;
+    bodies.accelerationY[i] = 0;
+    bodies.flags[i] |= BODY_MOVED;
+  }
+}
+
+void XPhysicsEngine::forEachChunk(
+    size_t count, const std::function<void(size_t, size_t)> &task) {
+  if (!threadPool) {
+    task(0, count);
+    return;
+  }
+
+  size_t chunkCount =
+      (count + INTEGRATION_CHUNK_SIZE - 1) / INTEGRATION_CHUNK_SIZE;
+  threadPool->parallelFor(chunkCount, [&](size_t chunk) {
+    size_t begin = chunk * INTEGRATION_CHUNK_SIZE;
+    task(begin, std::min(begin + INTEGRATION_CHUNK_SIZE, count));
+  });
+}
+
+void XPhysicsEngine::syncBody(GameObject &gameObject) {
+  if (gameObject.slot != -1) {
+    bodies.pull(gameObject.slot);
+  }
+}
+
+void XPhysicsEngine::syncObject(GameObject &gameObject) {
+  if (!bodiesAhead || gameObject.slot == -1 ||
+      !(bodies.flags[gameObject.slot] & BODY_MOVED)) {
+    return;
+  }
+
+  bodies.push(gameObject.slot);
+  bodies.flags[gameObject.slot] &= ~BODY_MOVED;
+  collisionEngine->updateObjectQuadrants(bodies.handles[gameObject.slot],
+                                         bodies.handles[gameObject.slot]);
+}
+
+void XPhysicsEngine::syncObjects() {
+  if (!bodiesAhead) {
+    return;
+  }
+
+  for (size_t slot = 0; slot < bodies.size(); slot++) {
+    if (!(bodies.flags[slot] & BODY_MOVED)) {
+      continue;
+    }
+    bodies.push(slot);
+    bodies.flags[slot] &= ~BODY_MOVED;
+    collisionEngine->updateObjectQuadrants(bodies.handles[slot],
+                                           bodies.handles[slot]);
+  }
+  bodiesAhead = false;
+}
+
+void XPhysicsEngine::detectCollisions(std::shared_ptr<GameObject> &gameObject) {
+  std::vector<std::shared_ptr<GameObject>> colliders =
+      collisionEngine->getCollisionsWithObject(gameObject);
+
+  for (auto iter = colliders.begin(); iter != colliders.end(); iter++) {
+    onCollision(gameObject, (*iter));
+  }
+}
+
+void XPhysicsEngine::detectAllCollisions() {
+  std::vector<Collision> found = collisionEngine->getAllCollisions();
+
+  for (auto iter = found.begin(); iter != found.end(); iter++) {
+    // Objects resting against each other stay asleep, as they would had
+    // each awake object looked for its own collisions
+    if (iter->collider1->sleeping && iter->collider2->sleeping) {
+      continue;
+    }
+    onCollision(iter->collider1, iter->collider2);
+  }
+}
+
+void XPhysicsEngine::sweepObject(std::shared_ptr<GameObject> &gameObject,
+                                 physics::Position2D displacement) {
+  // Sub-steps no longer than the hitbox keep the swept boxes small
+  double steps = std::max(
+      std::abs(displacement.x) / std::max(gameObject->hitboxWidth, 1.0),
+      std::abs(displacement.y) / std::max(gameObject->hitboxHeight, 1.0));
+  int substeps = std::clamp(static_cast<int>(std::ceil(steps)), 1,
+                            MAX_SWEEP_SUBSTEPS);
+  physics::Position2D step = displacement / substeps;
+
+  // The swept boxes are queried without moving the object, whose quadrants
+  // are updated once by the caller at its final position
+  physics::Position2D position = gameObject->position;
+  for (int i = 0; i < substeps; i++) {
+    AABB start = {position.x, position.y, position.x + gameObject->hitboxWidth,
+                  position.y + gameObject->hitboxHeight};
+
+    // Stretch the hitbox over the whole sub-step to gather every object the
+    // sweep could touch, even when the sub-step is capped
+    AABB sweptBox = {std::min(start.minX, start.minX + step.x),
+                     std::min(start.minY, start.minY + step.y),
+                     std::max(start.maxX, start.maxX + step.x),
+                     std::max(start.maxY, start.maxY + step.y)};
+    collisionEngine->queryRegion(sweptBox, sweepColliders);
+
+    // Objects it already overlapped are resting contacts, not impacts
+    double timeOfImpact = 1;
+    sweepHits.clear();
+    for (int colliderID : sweepColliders) {
+      std::shared_ptr<GameObject> *collider = findObject(colliderID);
+      if (collider == nullptr || *collider == gameObject ||
+          !filtersMatch(*gameObject, **collider)) {
+        continue;
+      }
+      AABB target = AABB::fromHitbox(**collider);
+      if (start.overlaps(target)) {
+        continue;
+      }
+      double time = sweptTimeOfImpact(start, step.x, step.y, target);
+      if (time < 1) {
+        timeOfImpact = std::min(timeOfImpact, time);
+        sweepHits.emplace_back(time, collider);
+      }
+    }
+
+    if (sweepHits.empty()) {
+      position += step;
+      continue;
+    }
+
+    gameObject->position = position + step * timeOfImpact;
+    for (auto iter = sweepHits.begin(); iter != sweepHits.end(); iter++) {
+      if (iter->first <= timeOfImpact) {
+        onCollision(gameObject, *iter->second);
+      }
+    }
+    return;
+  }
+  gameObject->position = position;
+}
+
 void XPhysicsEngine::onCollision(std::shared_ptr<GameObject> &go1,
                                  std::shared_ptr<GameObject> &go2) {
-  // TODO: Implement later
+  wakeObject(*go1);
+  wakeObject(*go2);
+  contactSolver.addContact(go1, go2);
+}
+
+void XPhysicsEngine::resolveCollisions() {
+  contactSolver.solve(solverIterations);
+
+  // Only the bodies of the contacts solved were moved. A body in several
+  // contacts is updated again, which finds it in the same quadrants
+  for (Contact *contact : contactSolver.getActiveContacts()) {
+    collisionEngine->updateObjectQuadrants(contact->body1, contact->body1);
+    syncBody(*contact->body1);
+    collisionEngine->updateObjectQuadrants(contact->body2, contact->body2);
+    syncBody(*contact->body2);
+  }
+}
+
+void XPhysicsEngine::updateSleeping() {
+  if (storageMode == ARRAY_STORAGE) {
+    if (contactSolver.getActiveContacts().empty()) {
+      updateSleepingBodies();
+      return;
+    }
+    syncObjects();
+  }
+
+  awakeObjects.clear();
+  if (player) {
+    awakeObjects.push_back(&player);
+  }
+  if (storageMode == ARRAY_STORAGE) {
+    for (size_t slot = 0; slot < bodies.size(); slot++) {
+      if (!(bodies.flags[slot] & BODY_SLEEPING)) {
+        awakeObjects.push_back(&bodies.handles[slot]);
+      }
+    }
+  } else {
+    for (auto iter = gameObjects.begin(); iter != gameObjects.end(); iter++) {
+      if (!(*iter)->sleeping) {
+        awakeObjects.push_back(&*iter);
+      }
+    }
+  }
+
+  islandParents.resize(awakeObjects.size());
+  islandSleepFrames.assign(awakeObjects.size(), INT_MAX);
+  islandIDs.assign(awakeObjects.size(), -1);
+  for (size_t i = 0; i < awakeObjects.size(); i++) {
+    GameObject &gameObject = **awakeObjects[i];
+    gameObject.island = i;
+    islandParents[i] = i;
+
+    double dx = gameObject.position.x - gameObject.lastPosition.x;
+    double dy = gameObject.position.y - gameObject.lastPosition.y;
+    gameObject.lastPosition = gameObject.position;
+    bool still = dx * dx + dy * dy < SLEEP_DISTANCE * SLEEP_DISTANCE;
+    gameObject.sleepFrames = still ? gameObject.sleepFrames + 1 : 0;
+    syncBody(gameObject);
+  }
+  // The player is driven by input, so it and anything touching it stay awake
+  if (player) {
+    player->sleepFrames = 0;
+  }
+
+  for (const Contact *contact : contactSolver.getActiveContacts()) {
+    int island1 = findIsland(contact->body1->island);
+    int island2 = findIsland(contact->body2->island);
+    islandParents[island1] = island2;
+  }
+
+  for (size_t i = 0; i < awakeObjects.size(); i++) {
+    int island = findIsland(i);
+    islandSleepFrames[island] =
+        std::min(islandSleepFrames[island], (*awakeObjects[i])->sleepFrames);
+  }
+
+  for (size_t i = 0; i < awakeObjects.size(); i++) {
+    int island = findIsland(i);
+    if (islandSleepFrames[island] < SLEEP_FRAMES) {
+      continue;
+    }
+
+    if (islandIDs[island] == -1) {
+      islandIDs[island] = nextIslandID++;
+    }
+    std::shared_ptr<GameObject> &gameObject = *awakeObjects[i];
+    gameObject->sleeping = true;
+    gameObject->island = islandIDs[island];
+    gameObject->speed = physics::Speed2D(0, 0);
+    gameObject->acceleration = physics::Acceleration2D(0, 0);
+    syncBody(*gameObject);
+    sleepingIslands[gameObject->island].push_back(gameObject);
+  }
+}
+
+void XPhysicsEngine::updateSleepingBodies() {
+  // The player is driven by input, so it stays awake
+  if (player) {
+    player->lastPosition = player->position;
+    player->sleepFrames = 0;
+  }
+
+  for (size_t slot = 0; slot < bodies.size(); slot++) {
+    if (bodies.flags[slot] & BODY_SLEEPING) {
+      continue;
+    }
+
+    double dx = bodies.positionX[slot] - bodies.lastPositionX[slot];
+    double dy = bodies.positionY[slot] - bodies.lastPositionY[slot];
+    bodies.lastPositionX[slot] = bodies.positionX[slot];
+    bodies.lastPositionY[slot] = bodies.positionY[slot];
+    bool still = dx * dx + dy * dy < SLEEP_DISTANCE * SLEEP_DISTANCE;
+    bodies.sleepFrames[slot] = still ? bodies.sleepFrames[slot] + 1 : 0;
+    if (bodies.sleepFrames[slot] < SLEEP_FRAMES) {
+      continue;
+    }
+
+    std::shared_ptr<GameObject> &gameObject = bodies.handles[slot];
+    syncObject(*gameObject);
+    gameObject->sleeping = true;
+    gameObject->island = nextIslandID++;
+    gameObject->speed = physics::Speed2D(0, 0);
+    gameObject->acceleration = physics::Acceleration2D(0, 0);
+    syncBody(*gameObject);
+    sleepingIslands[gameObject->island].push_back(gameObject);
+  }
+}
+
+int XPhysicsEngine::findIsland(int index) {
+  while (islandParents[index] != index) {
+    islandParents[index] = islandParents[islandParents[index]];
+    index = islandParents[index];
+  }
+  return index;
+}
+
+void XPhysicsEngine::wakeObject(GameObject &gameObject) {
+  if (!gameObject.sleeping) {
+    return;
+  }
+
+  auto island = sleepingIslands.find(gameObject.island);
+  for (std::shared_ptr<GameObject> &member : island->second) {
+    member->sleeping = false;
+    member->sleepFrames = 0;
+    member->lastPosition = member->position;
+    syncBody(*member);
+  }
+  sleepingIslands.erase(island);
 }
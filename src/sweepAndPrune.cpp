@@ -0,0 +1,361 @@
+#include "collisionEngine.h"
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+static bool endpointBefore(const SweepEndpoint &e1, const SweepEndpoint &e2) {
+  // Touching intervals do not overlap, so at equal values max endpoints go
+  // first
+  return e1.value < e2.value ||
+         (e1.value == e2.value && !e1.isMin && e2.isMin);
+}
+
+static uint64_t pairKey(int proxy1, int proxy2) {
+  return (static_cast<uint64_t>(std::min(proxy1, proxy2)) << 32) |
+         static_cast<uint32_t>(std::max(proxy1, proxy2));
+}
+
+SweepAndPruneCollisionEngine::SweepAndPruneCollisionEngine()
+    : SweepAndPruneCollisionEngine(false) {}
+
+SweepAndPruneCollisionEngine::SweepAndPruneCollisionEngine(bool sortYAxis)
+    : axisCount(sortYAxis ? 2 : 1) {}
+
+std::vector<Collision> SweepAndPruneCollisionEngine::getAllCollisions() {
+  return collectCollisions(
+      threadPool.get(), proxies.size(),
+      [this](size_t begin, size_t end, size_t chunk,
+             std::vector<Collision> &collisions) {
+        for (size_t p = begin; p < end; p++) {
+          const SweepProxy &proxy = proxies[p];
+          for (int other : proxy.overlaps) {
+            if (other > static_cast<int>(p) &&
+                hitboxesOverlap(*proxy.gameObject,
+                                *proxies[other].gameObject)) {
+              collisions.emplace_back(proxy.gameObject,
+                                      proxies[other].gameObject);
+            }
+          }
+        }
+      });
+}
+
+std::vector<std::shared_ptr<GameObject>>
+SweepAndPruneCollisionEngine::getCollisionsWithObject(
+    std::shared_ptr<GameObject> &gameObject) {
+  std::vector<std::shared_ptr<GameObject>> colliders;
+
+  auto index = proxyIndexes.find(gameObject->id);
+  if (index == proxyIndexes.end()) {
+    return colliders;
+  }
+
+  for (int other : proxies[index->second].overlaps) {
+    const std::shared_ptr<GameObject> &collider = proxies[other].gameObject;
+    if (hitboxesOverlap(*gameObject, *collider)) {
+      colliders.push_back(collider);
+    }
+  }
+
+  return colliders;
+}
+
+bool SweepAndPruneCollisionEngine::objectsCollided(
+    const std::shared_ptr<GameObject> &o1,
+    const std::shared_ptr<GameObject> &o2) {
+  return hitboxesOverlap(*o1, *o2);
+}
+
+void SweepAndPruneCollisionEngine::addGameObject(
+    std::shared_ptr<GameObject> gameObject) {
+  if (proxyIndexes.contains(gameObject->id)) {
+    return;
+  }
+
+  int proxy;
+  if (freeProxies.empty()) {
+    proxy = proxies.size();
+    proxies.emplace_back();
+  } else {
+    proxy = freeProxies.back();
+    freeProxies.pop_back();
+  }
+  proxies[proxy].gameObject = gameObject;
+  proxyIndexes.emplace(gameObject->id, proxy);
+
+  // New endpoints start past the end of the axis and are sorted into place
+  const double infinity = std::numeric_limits<double>::infinity();
+  for (int axis = 0; axis < axisCount; axis++) {
+    std::vector<SweepEndpoint> &endpoints = axes[axis];
+    proxies[proxy].endpointIndexes[axis][0] = endpoints.size();
+    endpoints.push_back({infinity, proxy, true});
+    proxies[proxy].endpointIndexes[axis][1] = endpoints.size();
+    endpoints.push_back({infinity, proxy, false});
+
+    moveInterval(axis, proxy, objectMin(*gameObject, axis),
+                 objectMax(*gameObject, axis));
+  }
+}
+
+void SweepAndPruneCollisionEngine::removeGameObject(
+    std::shared_ptr<GameObject> &gameObject) {
+  auto index = proxyIndexes.find(gameObject->id);
+  if (index == proxyIndexes.end()) {
+    return;
+  }
+
+  int proxy = index->second;
+
+  // Sorting the endpoints past the end of the axis ends every overlap
+  const double infinity = std::numeric_limits<double>::infinity();
+  for (int axis = 0; axis < axisCount; axis++) {
+    moveInterval(axis, proxy, infinity, infinity);
+    axes[axis].pop_back();
+    axes[axis].pop_back();
+  }
+
+  proxies[proxy].gameObject = NULL;
+  proxies[proxy].overlaps.clear();
+  freeProxies.push_back(proxy);
+  proxyIndexes.erase(index);
+}
+
+void SweepAndPruneCollisionEngine::updateObjectQuadrants(
+    std::shared_ptr<GameObject> &previousState,
+    std::shared_ptr<GameObject> &newState) {
+  auto index = proxyIndexes.find(newState->id);
+  if (index == proxyIndexes.end()) {
+    addGameObject(newState);
+    return;
+  }
+
+  for (int axis = 0; axis < axisCount; axis++) {
+    moveInterval(axis, index->second, objectMin(*newState, axis),
+                 objectMax(*newState, axis));
+  }
+}
+
+void SweepAndPruneCollisionEngine::setWorldSize(int width, int height) {}
+
+void SweepAndPruneCollisionEngine::updateObjectFilter(
+    std::shared_ptr<GameObject> &gameObject) {
+  if (proxyIndexes.contains(gameObject->id)) {
+    removeGameObject(gameObject);
+    addGameObject(gameObject);
+  }
+}
+
+void SweepAndPruneCollisionEngine::setThreadPool(
+    std::shared_ptr<ThreadPool> threadPool) {
+  this->threadPool = threadPool;
+}
+
+void SweepAndPruneCollisionEngine::queryRegion(const AABB &region,
+                                               std::vector<int> &result) {
+  result.clear();
+
+  forEachInXRange(region, [&](const GameObject &gameObject) {
+    if (AABB::fromHitbox(gameObject).overlaps(region)) {
+      result.push_back(gameObject.id);
+    }
+  });
+}
+
+void SweepAndPruneCollisionEngine::raycast(double x, double y, double dx,
+                                           double dy,
+                                           std::vector<RaycastHit> &hits) {
+  hits.clear();
+
+  AABB bounds = {std::min(x, x + dx), std::min(y, y + dy), std::max(x, x + dx),
+                 std::max(y, y + dy)};
+  double time;
+  forEachInXRange(bounds, [&](const GameObject &gameObject) {
+    if (segmentHitsBox(AABB::fromHitbox(gameObject), x, y, dx, dy, time)) {
+      hits.push_back({gameObject.id, time});
+    }
+  });
+
+  std::sort(hits.begin(), hits.end(),
+            [](const RaycastHit &h1, const RaycastHit &h2) {
+              return h1.time < h2.time || (h1.time == h2.time && h1.id < h2.id);
+            });
+}
+
+void SweepAndPruneCollisionEngine::nearest(double x, double y, int k,
+                                           std::vector<int> &result) {
+  nearestCandidates.clear();
+  if (k <= 0 || proxyIndexes.empty()) {
+    result.clear();
+    return;
+  }
+
+  // Query boxes around the point, doubling their size until they hold k
+  // objects and the k-th nearest is closer than anything outside the box
+  bool complete = false;
+  double radius = std::max(maxExtentX, 1.0);
+  for (int i = 0; i < SWEEP_NEAREST_MAX_DOUBLINGS && !complete; i++) {
+    AABB region = {x - radius, y - radius, x + radius, y + radius};
+    size_t found = 0;
+    nearestCandidates.clear();
+    forEachInXRange(region, [&](const GameObject &gameObject) {
+      AABB box = AABB::fromHitbox(gameObject);
+      if (box.overlaps(region)) {
+        found++;
+        pushNearestCandidate(nearestCandidates, k,
+                             squaredDistanceToBox(box, x, y), gameObject.id);
+      }
+    });
+
+    complete = found == proxyIndexes.size() ||
+               (nearestCandidates.size() == static_cast<size_t>(k) &&
+                nearestCandidates.front().first < radius * radius);
+    radius *= 2;
+  }
+
+  // Boxes never settle around a point or objects that are not finite, every
+  // proxy is looked at then
+  if (!complete) {
+    nearestCandidates.clear();
+    for (const SweepProxy &proxy : proxies) {
+      if (proxy.gameObject) {
+        pushNearestCandidate(
+            nearestCandidates, k,
+            squaredDistanceToBox(AABB::fromHitbox(*proxy.gameObject), x, y),
+            proxy.gameObject->id);
+      }
+    }
+  }
+
+  writeNearestCandidates(nearestCandidates, result);
+}
+
+void SweepAndPruneCollisionEngine::moveEndpoint(int axis, int proxy, int end,
+                                                double value) {
+  std::vector<SweepEndpoint> &endpoints = axes[axis];
+  int i = proxies[proxy].endpointIndexes[axis][end];
+  endpoints[i].value = value;
+  const SweepEndpoint endpoint = endpoints[i];
+
+  while (i > 0 && endpointBefore(endpoint, endpoints[i - 1])) {
+    const SweepEndpoint &previous = endpoints[i - 1];
+    if (previous.proxy != proxy && endpoint.isMin != previous.isMin) {
+      // A min passing a max to the left starts an overlap, a max passing a
+      // min ends one
+      setPairAxis(proxy, previous.proxy, axis, endpoint.isMin);
+    }
+    endpoints[i] = previous;
+    proxies[previous.proxy].endpointIndexes[axis][previous.isMin ? 0 : 1] = i;
+    i--;
+  }
+
+  while (i + 1 < static_cast<int>(endpoints.size()) &&
+         endpointBefore(endpoints[i + 1], endpoint)) {
+    const SweepEndpoint &next = endpoints[i + 1];
+    if (next.proxy != proxy && endpoint.isMin != next.isMin) {
+      setPairAxis(proxy, next.proxy, axis, !endpoint.isMin);
+    }
+    endpoints[i] = next;
+    proxies[next.proxy].endpointIndexes[axis][next.isMin ? 0 : 1] = i;
+    i++;
+  }
+
+  endpoints[i] = endpoint;
+  proxies[proxy].endpointIndexes[axis][end] = i;
+}
+
+void SweepAndPruneCollisionEngine::setPairAxis(int proxy1, int proxy2,
+                                               int axis, bool overlapping) {
+  const unsigned char allAxes = (1 << axisCount) - 1;
+  const uint64_t key = pairKey(proxy1, proxy2);
+
+  auto result = pairAxes.find(key);
+  if (result == pairAxes.end()) {
+    if (!overlapping) {
+      return;
+    }
+    result = pairAxes.emplace(key, 0).first;
+  }
+
+  bool wasOverlapping = result->second == allAxes;
+  if (overlapping) {
+    result->second |= 1 << axis;
+  } else {
+    result->second &= ~(1 << axis);
+  }
+  bool isOverlapping = result->second == allAxes;
+
+  // Pairs that can not collide never enter the overlap lists. Filters may
+  // have changed since the pair started overlapping, so ending pairs are
+  // looked up whatever the filters say
+  std::vector<int> &overlaps1 = proxies[proxy1].overlaps;
+  std::vector<int> &overlaps2 = proxies[proxy2].overlaps;
+  if (!wasOverlapping && isOverlapping) {
+    if (filtersMatch(*proxies[proxy1].gameObject,
+                     *proxies[proxy2].gameObject)) {
+      overlaps1.push_back(proxy2);
+      overlaps2.push_back(proxy1);
+    }
+  } else if (wasOverlapping && !isOverlapping) {
+    auto other = std::find(overlaps1.begin(), overlaps1.end(), proxy2);
+    if (other != overlaps1.end()) {
+      overlaps1.erase(other);
+      overlaps2.erase(std::find(overlaps2.begin(), overlaps2.end(), proxy1));
+    }
+  }
+
+  if (result->second == 0) {
+    pairAxes.erase(result);
+  }
+}
+
+void SweepAndPruneCollisionEngine::moveInterval(int axis, int proxy, double min,
+                                                double max) {
+  const SweepProxy &sweepProxy = proxies[proxy];
+  double currentMin = axes[axis][sweepProxy.endpointIndexes[axis][0]].value;
+
+  if (axis == 0 && max - min > maxExtentX) {
+    maxExtentX = max - min;
+  }
+
+  if (min > currentMin) {
+    moveEndpoint(axis, proxy, 1, max);
+    moveEndpoint(axis, proxy, 0, min);
+  } else {
+    moveEndpoint(axis, proxy, 0, min);
+    moveEndpoint(axis, proxy, 1, max);
+  }
+}
+
+template <typename Callback>
+void SweepAndPruneCollisionEngine::forEachInXRange(const AABB &region,
+                                                   Callback callback) {
+  const std::vector<SweepEndpoint> &endpoints = axes[0];
+  // No interval is longer than maxExtentX, so the ones starting before this
+  // end before the region
+  auto begin = std::lower_bound(
+      endpoints.begin(), endpoints.end(), region.minX - maxExtentX,
+      [](const SweepEndpoint &e, double value) { return e.value < value; });
+  auto end = std::upper_bound(
+      begin, endpoints.end(), region.maxX,
+      [](double value, const SweepEndpoint &e) { return value < e.value; });
+
+  for (auto iter = begin; iter != end; iter++) {
+    const SweepProxy &proxy = proxies[iter->proxy];
+    if (iter->isMin && endpoints[proxy.endpointIndexes[0][1]].value >=
+                           region.minX) {
+      callback(*proxy.gameObject);
+    }
+  }
+}
+
+double SweepAndPruneCollisionEngine::objectMin(const GameObject &gameObject,
+                                               int axis) {
+  return axis == 0 ? gameObject.position.x : gameObject.position.y;
+}
+
+double SweepAndPruneCollisionEngine::objectMax(const GameObject &gameObject,
+                                               int axis) {
+  return axis == 0 ? gameObject.position.x + gameObject.hitboxWidth
+                   : gameObject.position.y + gameObject.hitboxHeight;
+}
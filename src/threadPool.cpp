@@ -0,0 +1,81 @@
+#include "threadPool.h"
+#include <functional>
+#include <mutex>
+#include <thread>
+
+ThreadPool::ThreadPool(int threadCount) : nextTask(0) {
+  for (int i = 1; i < threadCount; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  batchStarted.notify_all();
+
+  for (auto iter = workers.begin(); iter != workers.end(); iter++) {
+    iter->join();
+  }
+}
+
+int ThreadPool::getThreadCount() { return workers.size() + 1; }
+
+void ThreadPool::parallelFor(size_t taskCount,
+                             const std::function<void(size_t)> &task) {
+  if (workers.empty() || taskCount <= 1) {
+    for (size_t i = 0; i < taskCount; i++) {
+      task(i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->task = &task;
+    this->taskCount = taskCount;
+    nextTask = 0;
+    busyWorkers = workers.size();
+    generation++;
+  }
+  batchStarted.notify_all();
+
+  runTasks();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  batchFinished.wait(lock, [this]() { return busyWorkers == 0; });
+  this->task = nullptr;
+}
+
+void ThreadPool::workerLoop() {
+  unsigned long lastGeneration = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      batchStarted.wait(lock, [&]() {
+        return stopping || generation != lastGeneration;
+      });
+      if (stopping) {
+        return;
+      }
+      lastGeneration = generation;
+    }
+
+    runTasks();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--busyWorkers == 0) {
+      batchFinished.notify_one();
+    }
+  }
+}
+
+void ThreadPool::runTasks() {
+  size_t i;
+  while ((i = nextTask.fetch_add(1)) < taskCount) {
+    (*task)(i);
+  }
+}
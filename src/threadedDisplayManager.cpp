@@ -0,0 +1,387 @@
+#include "threadedDisplayManager.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <utility>
+
+static void signalFD(int fd) {
+  uint64_t one = 1;
+  while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR) {
+  }
+}
+
+void SceneVisitor::visitRectangle(const Rectangle &rectangle) {
+  object.id = rectangle.id;
+  object.position = rectangle.position;
+  object.previousPosition = rectangle.previousPosition;
+  object.width = rectangle.width;
+  object.height = rectangle.height;
+}
+
+/**
+ * Notes the window resizes of the render thread's display manager
+ */
+struct RenderWindowObserver : Observer {
+  bool resized = false;
+
+  void onNotified() override { resized = true; }
+};
+
+/**
+ * Mirrors render scenes into rectangles drawn by a display manager, adding
+ * and removing them as objects come and go
+ */
+class SceneMirror {
+  struct Proxy {
+    std::shared_ptr<DisplayVisitable> displayable;
+    Rectangle *rectangle = nullptr;
+    bool visible = true;
+    // Set when the proxy's object is in the scene being mirrored
+    bool seen = false;
+  };
+
+  DisplayManager &displayManager;
+  // Proxy of each object by ID
+  std::unordered_map<int, Proxy> proxies;
+  Proxy player;
+  int playerID = -1;
+
+  static Proxy createProxy(const RenderObject &object) {
+    std::shared_ptr<Rectangle> rectangle =
+        std::make_shared<Rectangle>(object.id, object.width, object.height, 0);
+    Proxy proxy;
+    proxy.rectangle = rectangle.get();
+    proxy.displayable = rectangle;
+    return proxy;
+  }
+
+  void updateProxy(Proxy &proxy, const RenderObject &object) {
+    proxy.rectangle->position = object.position;
+    proxy.rectangle->previousPosition = object.previousPosition;
+    proxy.rectangle->width = object.width;
+    proxy.rectangle->height = object.height;
+    if (proxy.visible != object.visible) {
+      if (object.visible) {
+        displayManager.setVisible(proxy.displayable);
+      } else {
+        displayManager.setInvisible(proxy.displayable);
+      }
+      proxy.visible = object.visible;
+    }
+    proxy.seen = true;
+  }
+
+public:
+  SceneMirror(DisplayManager &displayManager)
+      : displayManager(displayManager) {}
+
+  void mirror(const RenderScene &scene) {
+    if (scene.hasPlayer) {
+      if (!player.displayable || playerID != scene.player.id) {
+        player = createProxy(scene.player);
+        playerID = scene.player.id;
+        displayManager.setPlayer(player.displayable);
+      }
+      updateProxy(player, scene.player);
+    } else if (player.displayable) {
+      displayManager.removePlayer();
+      player = Proxy();
+    }
+
+    for (auto iter = proxies.begin(); iter != proxies.end(); iter++) {
+      iter->second.seen = false;
+    }
+    for (auto iter = scene.objects.begin(); iter != scene.objects.end();
+         iter++) {
+      auto result = proxies.find(iter->id);
+      if (result == proxies.end()) {
+        result = proxies.emplace(iter->id, createProxy(*iter)).first;
+        displayManager.addDisplayable(result->second.displayable);
+      }
+      updateProxy(result->second, *iter);
+    }
+    for (auto iter = proxies.begin(); iter != proxies.end();) {
+      if (iter->second.seen) {
+        iter++;
+        continue;
+      }
+      displayManager.removeDisplayable(iter->second.displayable);
+      iter = proxies.erase(iter);
+    }
+  }
+};
+
+ThreadedDisplayManager::ThreadedDisplayManager(
+    DisplayManagerType displayManagerType, int windowWidth, int windowHeight,
+    int borderWidth)
+    : windowWidth(windowWidth), windowHeight(windowHeight),
+      borderWidth(borderWidth), displayManagerType(displayManagerType),
+      renderWindowWidth(windowWidth), renderWindowHeight(windowHeight) {
+  wakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  inputFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  renderThread = std::thread(&ThreadedDisplayManager::renderLoop, this,
+                             windowWidth, windowHeight, borderWidth);
+}
+
+ThreadedDisplayManager::~ThreadedDisplayManager() {
+  stopFlag = true;
+  wakeRenderThread();
+  renderThread.join();
+  close(wakeFD);
+  close(inputFD);
+}
+
+void ThreadedDisplayManager::wakeRenderThread() { signalFD(wakeFD); }
+
+void ThreadedDisplayManager::renderLoop(int windowWidth, int windowHeight,
+                                        int borderWidth) {
+  // Made on this thread, so that it alone uses the X connection
+  DisplayManagerFactory displayManagerFactory;
+  std::shared_ptr<DisplayManager> displayManager =
+      displayManagerFactory.createDisplayManager(
+          displayManagerType, windowWidth, windowHeight, borderWidth);
+  std::shared_ptr<RenderWindowObserver> windowObserver =
+      std::make_shared<RenderWindowObserver>();
+  displayManager->addObserver(windowObserver);
+  SceneMirror sceneMirror(*displayManager);
+
+  while (!stopFlag) {
+    displayManager->handleEvents();
+    const std::vector<Key> &keys = displayManager->getKeyPresses();
+    if (!keys.empty() || windowObserver->resized) {
+      {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        renderKeysPressed.insert(renderKeysPressed.end(), keys.begin(),
+                                 keys.end());
+        if (windowObserver->resized) {
+          windowResized = true;
+          renderWindowWidth = displayManager->getWindowWidth();
+          renderWindowHeight = displayManager->getWindowHeight();
+        }
+      }
+      displayManager->clearKeyPresses();
+      windowObserver->resized = false;
+      inputPending = true;
+      signalFD(inputFD);
+    }
+
+    int renderMode, width, height, border;
+    {
+      std::lock_guard<std::mutex> lock(eventMutex);
+      renderMode = std::exchange(requestedRenderMode, -1);
+      width = std::exchange(requestedWindowWidth, -1);
+      height = std::exchange(requestedWindowHeight, -1);
+      border = std::exchange(requestedBorderWidth, -1);
+    }
+    if (renderMode != -1) {
+      displayManager->setRenderMode((RenderMode)renderMode);
+    }
+    if (width != -1) {
+      displayManager->setWindowSize(width, height);
+    }
+    if (border != -1) {
+      displayManager->setBorderWidth(border);
+    }
+
+    if (scenes.update()) {
+      const RenderScene &scene = scenes.getReadBuffer();
+      sceneMirror.mirror(scene);
+      displayManager->setInterpolationAlpha(scene.interpolationAlpha);
+      displayManager->onNotified();
+
+      std::lock_guard<std::mutex> lock(eventMutex);
+      renderStats = displayManager->getRenderStats();
+    }
+
+    if (stopFlag || displayManager->hasPendingEvents()) {
+      continue;
+    }
+    struct pollfd fds[2] = {{displayManager->getEventFD(), POLLIN, 0},
+                            {wakeFD, POLLIN, 0}};
+    while (poll(fds, 2, -1) == -1 && errno == EINTR) {
+    }
+    // Anything published before the wake up is taken on the next iteration
+    uint64_t wakeUps;
+    while (read(wakeFD, &wakeUps, sizeof(wakeUps)) > 0) {
+    }
+  }
+}
+
+void ThreadedDisplayManager::publishScene() {
+  RenderScene &scene = scenes.getWriteBuffer();
+  scene.interpolationAlpha = interpolationAlpha;
+
+  scene.hasPlayer = player != nullptr;
+  if (player) {
+    player->displayable->accept(sceneVisitor);
+    scene.player = sceneVisitor.object;
+    scene.player.visible = player->display;
+  }
+
+  scene.objects.clear();
+  for (auto iter = displayables.begin(); iter != displayables.end(); iter++) {
+    (*iter)->displayable->accept(sceneVisitor);
+    sceneVisitor.object.visible = (*iter)->display;
+    scene.objects.push_back(sceneVisitor.object);
+  }
+
+  scenes.publish();
+  wakeRenderThread();
+}
+
+void ThreadedDisplayManager::addObserver(std::shared_ptr<Observer> observer) {
+  observers.push_back(observer);
+}
+
+void ThreadedDisplayManager::removeObserver(
+    std::shared_ptr<Observer> &observer) {
+  observers.erase(std::remove(observers.begin(), observers.end(), observer),
+                  observers.end());
+}
+
+void ThreadedDisplayManager::notifyAll() {
+  for (auto iter = observers.begin(); iter != observers.end(); iter++) {
+    (*iter)->onNotified();
+  }
+}
+
+void ThreadedDisplayManager::onNotified() { publishScene(); }
+
+void ThreadedDisplayManager::addDisplayable(
+    std::shared_ptr<DisplayVisitable> object) {
+  displayableIndexes[object.get()] = displayables.size();
+  displayables.push_back(std::make_unique<Displayable>(object));
+}
+
+void ThreadedDisplayManager::setPlayer(
+    std::shared_ptr<DisplayVisitable> player) {
+  this->player = std::make_unique<Displayable>(player);
+}
+
+bool ThreadedDisplayManager::removeDisplayable(
+    std::shared_ptr<DisplayVisitable> &displayable) {
+  auto result = displayableIndexes.find(displayable.get());
+  if (result == displayableIndexes.end()) {
+    return false;
+  }
+
+  // Swap the last displayable into the freed place
+  size_t index = result->second;
+  displayableIndexes.erase(result);
+  if (index != displayables.size() - 1) {
+    displayables[index] = std::move(displayables.back());
+    displayableIndexes[displayables[index]->displayable.get()] = index;
+  }
+  displayables.pop_back();
+  return true;
+}
+
+void ThreadedDisplayManager::removePlayer() { player = NULL; }
+
+void ThreadedDisplayManager::setVisibility(
+    std::shared_ptr<DisplayVisitable> &displayable, bool visible) {
+  if (player && displayable == player->displayable) {
+    player->display = visible;
+    return;
+  }
+
+  auto result = displayableIndexes.find(displayable.get());
+  if (result == displayableIndexes.end()) {
+    return;
+  }
+
+  displayables[result->second]->display = visible;
+}
+
+void ThreadedDisplayManager::setInvisible(
+    std::shared_ptr<DisplayVisitable> &displayable) {
+  setVisibility(displayable, false);
+}
+
+void ThreadedDisplayManager::setVisible(
+    std::shared_ptr<DisplayVisitable> &displayable) {
+  setVisibility(displayable, true);
+}
+
+void ThreadedDisplayManager::draw() { publishScene(); }
+
+void ThreadedDisplayManager::erase() {}
+
+void ThreadedDisplayManager::setInterpolationAlpha(double alpha) {
+  interpolationAlpha = alpha;
+}
+
+void ThreadedDisplayManager::setRenderMode(RenderMode mode) {
+  {
+    std::lock_guard<std::mutex> lock(eventMutex);
+    requestedRenderMode = mode;
+  }
+  wakeRenderThread();
+}
+
+RenderStats ThreadedDisplayManager::getRenderStats() {
+  std::lock_guard<std::mutex> lock(eventMutex);
+  return renderStats;
+}
+
+void ThreadedDisplayManager::handleEvents() {
+  if (!inputPending.exchange(false)) {
+    return;
+  }
+  uint64_t inputs;
+  while (read(inputFD, &inputs, sizeof(inputs)) > 0) {
+  }
+
+  bool resized;
+  {
+    std::lock_guard<std::mutex> lock(eventMutex);
+    keysPressed.insert(keysPressed.end(), renderKeysPressed.begin(),
+                       renderKeysPressed.end());
+    renderKeysPressed.clear();
+    resized = std::exchange(windowResized, false);
+    if (resized) {
+      windowWidth = renderWindowWidth;
+      windowHeight = renderWindowHeight;
+    }
+  }
+  if (resized) {
+    notifyAll();
+  }
+}
+
+int ThreadedDisplayManager::getEventFD() { return inputFD; }
+
+bool ThreadedDisplayManager::hasPendingEvents() { return inputPending; }
+
+const std::vector<Key> &ThreadedDisplayManager::getKeyPresses() {
+  return keysPressed;
+}
+
+void ThreadedDisplayManager::clearKeyPresses() { keysPressed.clear(); }
+
+void ThreadedDisplayManager::setWindowSize(int width, int height) {
+  windowWidth = width;
+  windowHeight = height;
+  {
+    std::lock_guard<std::mutex> lock(eventMutex);
+    requestedWindowWidth = width;
+    requestedWindowHeight = height;
+  }
+  wakeRenderThread();
+}
+
+void ThreadedDisplayManager::setBorderWidth(int width) {
+  borderWidth = width;
+  {
+    std::lock_guard<std::mutex> lock(eventMutex);
+    requestedBorderWidth = width;
+  }
+  wakeRenderThread();
+}
+
+int ThreadedDisplayManager::getWindowWidth() { return windowWidth; }
+int ThreadedDisplayManager::getWindowHeight() { return windowHeight; }
+int ThreadedDisplayManager::getBorderWidth() { return borderWidth; }
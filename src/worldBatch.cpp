@@ -0,0 +1,116 @@
+#include "worldBatch.h"
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+WorldBatch::WorldBatch(const WorldConfig &config, int worldCount,
+                       std::shared_ptr<ThreadPool> threadPool)
+    : config(config), threadPool(threadPool) {
+  CollisionEngineFactory collisionEngineFactory;
+
+  for (int i = 0; i < worldCount; i++) {
+    CollisionEngine *collisionEngine =
+        collisionEngineFactory.createCollisionEngine(
+            config.collisionEngineType, config.worldWidth, config.worldHeight);
+
+    // Worlds run in parallel with each other, so each one steps on a single
+    // thread and never gets the pool
+    std::unique_ptr<PhysicsEngine> world = std::make_unique<XPhysicsEngine>(
+        config.gravityPull, config.jumpImpulse, config.walkingSpeed,
+        config.worldWidth, config.worldHeight, config.frameTimeDuration,
+        collisionEngine, config.collisions);
+    world->setStorageMode(config.storageMode);
+
+    worlds.push_back(std::move(world));
+  }
+  worldObjects.resize(worldCount);
+}
+
+int WorldBatch::getWorldCount() { return worlds.size(); }
+
+PhysicsEngine &WorldBatch::getWorld(int world) { return *worlds[world]; }
+
+void WorldBatch::addGameObject(int world,
+                               std::shared_ptr<GameObject> gameObject) {
+  worlds[world]->addGameObject(gameObject);
+  worldObjects[world].push_back(gameObject);
+  offsetsChanged = true;
+}
+
+bool WorldBatch::removeGameObject(int world,
+                                  std::shared_ptr<GameObject> &gameObject) {
+  std::vector<std::shared_ptr<GameObject>> &objects = worldObjects[world];
+  auto iter = std::find(objects.begin(), objects.end(), gameObject);
+  if (iter == objects.end()) {
+    return false;
+  }
+
+  worlds[world]->removeGameObject(gameObject);
+  objects.erase(iter);
+  offsetsChanged = true;
+  return true;
+}
+
+void WorldBatch::step(int steps) {
+  if (offsetsChanged) {
+    updateOffsets();
+  }
+
+  auto task = [this, steps](size_t world) {
+    for (int i = 0; i < steps; i++) {
+      worlds[world]->stepBy(config.frameTimeDuration);
+    }
+    gatherWorld(world);
+  };
+
+  if (threadPool) {
+    threadPool->parallelFor(worlds.size(), task);
+  } else {
+    for (size_t world = 0; world < worlds.size(); world++) {
+      task(world);
+    }
+  }
+}
+
+void WorldBatch::updateOffsets() {
+  objectOffsets.clear();
+  size_t total = 0;
+  for (auto iter = worldObjects.begin(); iter != worldObjects.end(); iter++) {
+    objectOffsets.push_back(total);
+    total += iter->size();
+  }
+  objectOffsets.push_back(total);
+
+  positionX.resize(total);
+  positionY.resize(total);
+  speedX.resize(total);
+  speedY.resize(total);
+  offsetsChanged = false;
+}
+
+void WorldBatch::gatherWorld(int world) {
+  worlds[world]->syncObjects();
+
+  size_t index = objectOffsets[world];
+  for (auto iter = worldObjects[world].begin();
+       iter != worldObjects[world].end(); iter++, index++) {
+    positionX[index] = (*iter)->position.x;
+    positionY[index] = (*iter)->position.y;
+    speedX[index] = (*iter)->speed.x;
+    speedY[index] = (*iter)->speed.y;
+  }
+}
+
+std::span<const size_t> WorldBatch::getObjectOffsets() {
+  if (offsetsChanged) {
+    updateOffsets();
+  }
+  return objectOffsets;
+}
+
+std::span<const double> WorldBatch::getPositionX() { return positionX; }
+std::span<const double> WorldBatch::getPositionY() { return positionY; }
+std::span<const double> WorldBatch::getSpeedX() { return speedX; }
+std::span<const double> WorldBatch::getSpeedY() { return speedY; }